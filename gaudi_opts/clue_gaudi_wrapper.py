@@ -58,6 +58,10 @@ MyClueGaudiAlgorithmWrapper.EndcapCaloHitsCollection = "ECALEndcap"
 MyClueGaudiAlgorithmWrapper.CriticalDistance = 15.00
 MyClueGaudiAlgorithmWrapper.MinLocalDensity = 0.02
 MyClueGaudiAlgorithmWrapper.OutlierDeltaFactor = 3.00
+# To cluster more collections in the same pass, each with its own geometry
+# (and optionally its own CriticalDistances, MinLocalDensities, OutlierDeltaFactors):
+# MyClueGaudiAlgorithmWrapper.InputCollections = ["ECALBarrel", "ECALEndcap", "HCALBarrel"]
+# MyClueGaudiAlgorithmWrapper.Geometries = ["CLICdetBarrel", "CLICdetEndcap", "CLDBarrel"]
 MyClueGaudiAlgorithmWrapper.OutputLevel = DEBUG
 
 MyCLUENtuplizer = CLUENtuplizer("CLUEAnalysis")
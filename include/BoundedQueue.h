@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BoundedQueue_h
+#define BoundedQueue_h
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+
+namespace clue {
+
+  /**
+   * Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's
+   * array queue): every cell carries a sequence number telling whether it
+   * is free for the producer of a given turn or full for its consumer, so
+   * push and pop only contend on one atomic increment.
+   * The capacity is rounded up to a power of two.
+   * push() and pop() block by spinning and then yielding; after close(),
+   * pop() drains what is left and then returns false.
+   */
+  template <typename T>
+  class BoundedQueue {
+  public:
+    explicit BoundedQueue(std::size_t capacity)
+        : mask_(std::bit_ceil(capacity < 2 ? std::size_t(2) : capacity) - 1), cells_(new Cell[mask_ + 1]) {
+      for (std::size_t i = 0; i <= mask_; ++i)
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    // number of elements, exact only when no push or pop is running
+    std::size_t sizeApprox() const {
+      auto head = dequeuePos_.load(std::memory_order_relaxed);
+      auto tail = enqueuePos_.load(std::memory_order_relaxed);
+      return tail > head ? tail - head : 0;
+    }
+
+    // returns false, and leaves `value` untouched, if the queue is full
+    bool tryPush(T& value) {
+      auto pos = enqueuePos_.load(std::memory_order_relaxed);
+      for (;;) {
+        Cell& cell = cells_[pos & mask_];
+        auto seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+          if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            cell.value.emplace(std::move(value));
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // returns false if the queue is empty
+    bool tryPop(T& value) {
+      auto pos = dequeuePos_.load(std::memory_order_relaxed);
+      for (;;) {
+        Cell& cell = cells_[pos & mask_];
+        auto seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+          if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            value = std::move(*cell.value);
+            cell.value.reset();
+            cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    void push(T value) {
+      for (unsigned spin = 0; !tryPush(value); ++spin)
+        backoff(spin);
+    }
+
+    // returns false once the queue is closed and empty
+    bool pop(T& value) {
+      for (unsigned spin = 0;; ++spin) {
+        if (tryPop(value))
+          return true;
+        if (closed_.load(std::memory_order_acquire))
+          return tryPop(value);
+        backoff(spin);
+      }
+    }
+
+    // to be called by the producers once they are done
+    void close() { closed_.store(true, std::memory_order_release); }
+
+  private:
+    struct Cell {
+      std::atomic<std::size_t> sequence;
+      std::optional<T> value;
+    };
+
+    static void backoff(unsigned spin) {
+      if (spin >= 64)
+        std::this_thread::yield();
+    }
+
+    const std::size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<std::size_t> enqueuePos_{0};
+    alignas(64) std::atomic<std::size_t> dequeuePos_{0};
+    alignas(64) std::atomic<bool> closed_{false};
+  };
+
+} // namespace clue
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BufferedWriter_h
+#define BufferedWriter_h
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace clue {
+
+  /**
+   * Output stream formatting numbers with std::to_chars into a fixed
+   * buffer, which is written to the file every time it fills up.
+   * Floating point numbers are formatted as std::ostream does by default
+   * (general format, 6 significant digits), without any allocation.
+   */
+  class BufferedWriter {
+  public:
+    static constexpr std::size_t bufferSize = 1 << 16;
+
+    // writes to an already open file (e.g. stdout), which is not closed
+    explicit BufferedWriter(std::FILE* file);
+    explicit BufferedWriter(const std::string& fileName, bool binary = false);
+    ~BufferedWriter();
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    bool good() const { return file_ != nullptr && !failed_; }
+    void flush();
+
+    void write(const void* data, std::size_t bytes) {
+      if (bytes > bufferSize - used_) {
+        flush();
+        if (bytes > bufferSize) {
+          writeThrough(data, bytes);
+          return;
+        }
+      }
+      std::memcpy(buffer_.get() + used_, data, bytes);
+      used_ += bytes;
+    }
+
+    BufferedWriter& operator<<(std::string_view s) {
+      write(s.data(), s.size());
+      return *this;
+    }
+
+    BufferedWriter& operator<<(char c) {
+      reserve(1);
+      buffer_[used_++] = c;
+      return *this;
+    }
+
+    template <typename T>
+    std::enable_if_t<std::is_integral_v<T>, BufferedWriter&> operator<<(T value) {
+      reserve(maxFieldSize);
+      used_ = std::to_chars(buffer_.get() + used_, buffer_.get() + bufferSize, value).ptr - buffer_.get();
+      return *this;
+    }
+
+    BufferedWriter& operator<<(float value) { return *this << static_cast<double>(value); }
+
+    BufferedWriter& operator<<(double value) {
+      reserve(maxFieldSize);
+      used_ = std::to_chars(buffer_.get() + used_, buffer_.get() + bufferSize, value, std::chars_format::general, 6).ptr -
+              buffer_.get();
+      return *this;
+    }
+
+  private:
+    // enough for any integer and for a double with 6 significant digits
+    static constexpr std::size_t maxFieldSize = 32;
+
+    void reserve(std::size_t bytes) {
+      if (bytes > bufferSize - used_)
+        flush();
+    }
+    void writeThrough(const void* data, std::size_t bytes);
+
+    std::FILE* file_;
+    bool owned_;
+    bool failed_ = false;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t used_ = 0;
+  };
+
+} // namespace clue
+
+#endif // BufferedWriter_h
@@ -20,20 +20,89 @@
 #define CLUEAlgo_h
 
 // C/C++ headers
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <utility>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+#include "CLUETracer.h"
 #include "LayerTiles.h"
 #include "Points.h"
 
-template <typename TILES>
+// Wall-clock time [ms] spent in each phase of the last makeClusters() call
+struct CLUETimings {
+  double prepareDataStructures = 0.;
+  double calculateLocalDensity = 0.;
+  double calculateDistanceToHigher = 0.;
+  double findSeedAndFollowers = 0.;
+  double assignClusters = 0.;
+  double total = 0.;
+};
+
+// Number of tiles visited and of pairs evaluated in one search pass
+struct CLUESearchCounters {
+  unsigned long long binsVisited = 0;
+  unsigned long long emptyBinsVisited = 0;
+  unsigned long long distancesEvaluated = 0;
+  unsigned long long acceptedNeighbours = 0;
+};
+
+// Hot-path counters of the last makeClusters() call.
+// They are only filled if CLUEAlgo_T is instantiated with COUNTERS = true.
+struct CLUECounters {
+  CLUESearchCounters localDensity;
+  CLUESearchCounters distanceToHigher;
+  // number of points in the most populated tile, per layer
+  std::vector<unsigned> maxTileOccupancy;
+  // average number of points in the non-empty tiles, per layer
+  std::vector<float> meanTileOccupancy;
+
+  void clear() {
+    localDensity = CLUESearchCounters();
+    distanceToHigher = CLUESearchCounters();
+    maxTileOccupancy.clear();
+    meanTileOccupancy.clear();
+  }
+};
+
+// Seeds and clusters of one setting of CLUEAlgo_T::scanClusters() or scanCriticalDistances()
+struct CLUEScanResult {
+  float dc = 0.f;
+  float rhoc = 0.f;
+  float outlierDeltaFactor = 0.f;
+  int nSeeds = 0;      // number of clusters, summed over the layers
+  int nOutliers = 0;   // number of points with clusterIndex -1
+  std::vector<int> isSeed;
+  std::vector<int> clusterIndex;
+};
+
+// How makeClusters() finds the nearest higher of the points:
+// Tiles searches the tiles of the layer and skips the points of lower density,
+// DensitySorted goes through the points by decreasing density and searches
+// tiles holding only the points already seen, i.e. the ones of higher density.
+// Both give the same results.
+enum class CLUEDeltaEngine { Tiles, DensitySorted };
+
+// points of each cluster, by clusterIndex (-1 collects the outliers)
+using CLUEClusterMap = std::pmr::map<int, std::pmr::vector<int>>;
+
+template <typename TILES, bool COUNTERS = false>
 class CLUEAlgo_T {
 
 public:
+  using tiles_type = TILES;
+  using constants_type_t = typename TILES::constants_type_t;
+  // binning, search window and distance of the points, see GeometryPolicies.h
+  using geometry_type = clue::geometry_t<constants_type_t>;
+  static_assert(clue::GeometryPolicy<geometry_type>);
+
   CLUEAlgo_T() {
     dc_ = 0.0;
     rhoc_ = 0.0;
@@ -55,45 +124,82 @@ public:
   // public variables
   float dc_, rhoc_, outlierDeltaFactor_;
   bool verbose_;
+  // if positive, two points are neighbours only if |t_i - t_j| < timeWindow_
+  float timeWindow_ = 0.f;
+  // if positive, makeClusters() searches the tiles only once, at the larger of
+  // dc and outlierDeltaFactor * dc, and keeps the neighbours found (8 bytes
+  // per pair) for the density and delta passes, as long as they fit in this
+  // many bytes; denser events fall back to the two tile searches
+  std::size_t neighbourCacheBytes_ = 0;
+  // if true, the nearest higher of the points with rho >= rhoc is only
+  // searched within dc: past it they are seeds whatever lies further out.
+  // The clusters do not change, but the seeds keep delta = max float and
+  // nearestHigher = -1 instead of their nearest higher within dm.
+  // scanClusters() ignores it, as its settings have their own rhoc
+  bool capSeedDelta_ = false;
+  // ignored when the neighbour cache is used
+  CLUEDeltaEngine deltaEngine_ = CLUEDeltaEngine::Tiles;
+  // if positive, clearAndSetPoints() only keeps the points with a weight of
+  // at least energyThreshold_ for the clustering, and makeClusters() (or the
+  // scans) map the results back to all the points, the others being outliers
+  // with rho 0 and no nearest higher
+  float energyThreshold_ = 0.f;
     
   Points points_;
+  CLUETimings timings_;
+  CLUECounters counters_;
   
-  bool clearAndSetPoints(int n, float* x, float* y, int* layer, float* weight, float* r = NULL) {
+  // The arrays are read in place, not copied: they must stay valid and unchanged as long as
+  // the points are used, i.e. until the next clearAndSetPoints(). Only the points kept by
+  // the energy prefilter are copied.
+  bool clearAndSetPoints(int n, const float* x, const float* y, const int* layer, const float* weight, const float* r = NULL,
+                         const float* time = NULL) {
     points_.clear();
-    // input variables
-    for(int i=0; i<n; ++i)
-      {
-	points_.x.push_back(x[i]);
-	points_.y.push_back(y[i]);
-	points_.layer.push_back(layer[i]);
-	points_.weight.push_back(weight[i]);
-	if(r != NULL){
-          points_.r.push_back(r[i]);
-        } else {
-          // If the layer tile is declared as endcap, the r info is not used
-          if(TILES::constants_type_t::endcap){
-            points_.r.push_back(0.0);
-          } else {
-            std::cerr << "ERROR: r info is not present but you are using a barrel LayerTile! " << std::endl;
-          }
-        }
-      }
+    if(r == NULL && geometry_type::needsRadius){
+      std::cerr << "ERROR: r info is not present but you are using a barrel LayerTile! " << std::endl;
+      return 1;
+    }
+    if(time == NULL && timeWindow_ > 0.f){
+      std::cerr << "ERROR: time info is not present but a time window is set! " << std::endl;
+      return 1;
+    }
+    inputs_ = {n, x, y, layer, weight, r, time};
+    filterPoints(n, weight);
+    if(!droppedPoints_.empty()){
+      // only the points above the threshold are clustered, restoreFilteredPoints() goes back to all of them
+      copyInputs(points_, keptPoints_, inputs_);
+    } else {
+      setInputs(points_, inputs_);
+    }
 
     points_.n = points_.x.size();
-    if(points_.n == 0)
+    if(points_.n == 0 && droppedPoints_.empty())
       return 1;
 
-    // result variables
+    geometry_type::preparePoints(points_);
+
+    // result variables, with room for all the points if restoreFilteredPoints() scatters them back
+    if(!droppedPoints_.empty()){
+      points_.rho.reserve(n);
+      points_.delta.reserve(n);
+      points_.nearestHigher.reserve(n);
+      points_.followers.reserve(n);
+      points_.clusterIndex.reserve(n);
+      points_.isSeed.reserve(n);
+    }
     points_.rho.resize(points_.n,0);
     points_.delta.resize(points_.n,std::numeric_limits<float>::max());
     points_.nearestHigher.resize(points_.n,-1);
     points_.followers.resize(points_.n);
     points_.clusterIndex.resize(points_.n,-1);
     points_.isSeed.resize(points_.n,0);
+    // all the points are below the energy threshold
+    if(points_.n == 0)
+      return 0;
 
     // consistency checks
     auto maxLayer = *std::max_element(points_.layer.begin(), points_.layer.end()); 
-    if(maxLayer > TILES::constants_type_t::nLayers){
+    if(maxLayer >= TILES::constants_type_t::nLayers){
       std::cerr << "Max layer(" << maxLayer << ") is larger "
                 << "than the number of layers(" << TILES::constants_type_t::nLayers << ") defined for the current detector" << std::endl;
       return 1;
@@ -120,66 +226,186 @@ public:
 
   void clearPoints(){ points_.clear(); }
   void clearLayerTiles(){
+    // the flat tiles are rebuilt in full at every event
+    if(flatTiles_)
+      return;
     for(unsigned i = 0; i < TILES::constants_type_t::nLayers; i++) {
       allLayerTiles_[i].clear();
     }
   }
-  void makeClusters();
-  std::map<int, std::vector<int> > getClusters();
-  Points const getPoints() const { return points_; };
-
-  void infoSeeds();
-  void infoHits();
-
-  std::string getVerboseString_(unsigned it,
-				float x, float y, int layer, float weight,
-				float rho, float delta,
-				int nh, int isseed, float clusterid) const {
-    std::stringstream s;
-    std::string sep = ",";
-    s << it << sep << x << sep << y << sep;
-    s << layer << sep << weight << sep << rho;
-    if (delta <= 999)
-      s << sep << delta;
-    else
-      s << ",999"; //convert +inf to 999 in verbose
-    s << sep << nh << sep << isseed << sep << clusterid << std::endl;
-    return s.str();
-  }
-  
-  void verboseResults(std::string outputFileName="cout", int nVerbose=-1) const {
-    if(verbose_)
-      {
-	if (nVerbose==-1) nVerbose=points_.n;
-    
-	std::string s;
-	s = "index,x,y,layer,weight,rho,delta,nh,isSeed,clusterId\n";
-	for(int i=0; i<nVerbose; i++) {
-	  s += getVerboseString_(i, points_.x[i], points_.y[i], points_.layer[i],
-				 points_.weight[i], points_.rho[i], points_.delta[i],
-				 points_.nearestHigher[i], points_.isSeed[i],
-				 points_.clusterIndex[i]);
-	}
-
-	if(outputFileName.compare("cout")==0) //verbose to screen
-	  std::cout << s << std::endl;
-	else { //verbose to file
-	  std::ofstream oFile(outputFileName);
-	  oFile << s;
-	  oFile.close();
-	}
-      }
+  // label of the detector region attached to the trace events
+  void setTraceRegion(const std::string& region) { traceRegion_ = clue::Tracer::instance().intern(region); }
+
+  /**
+   * Takes all the per-event memory (points, layer index, neighbour table,
+   * cluster stack and map) from mr, e.g. a clue::EventArena, instead of the
+   * heap. The memory of the previous resource is given back first, so call
+   * this before releasing it and then attach the new (or reset) one before
+   * the next event.
+   */
+  void setMemoryResource(std::pmr::memory_resource* mr) {
+    resource_ = mr;
+    std::destroy_at(&points_);
+    std::construct_at(&points_, mr);
+    std::destroy_at(&layerOffsets_);
+    std::construct_at(&layerOffsets_, mr);
+    std::destroy_at(&layerPoints_);
+    std::construct_at(&layerPoints_, mr);
+    std::destroy_at(&neighbourOffsets_);
+    std::construct_at(&neighbourOffsets_, mr);
+    std::destroy_at(&neighbours_);
+    std::construct_at(&neighbours_, mr);
+    std::destroy_at(&neighbourDistance2_);
+    std::construct_at(&neighbourDistance2_, mr);
+    std::destroy_at(&keptPoints_);
+    std::construct_at(&keptPoints_, mr);
+    std::destroy_at(&droppedPoints_);
+    std::construct_at(&droppedPoints_, mr);
+    std::destroy_at(&tilePoints_);
+    std::construct_at(&tilePoints_, mr);
   }
+
+  void makeClusters();
+  CLUEClusterMap getClusters();
+
+  /**
+   * Clusters the points once for each (rhoc, outlierDeltaFactor) pair of
+   * `settings`, for the current dc. The tiles and rho are computed once, and
+   * delta and nearestHigher once at the largest outlierDeltaFactor: the
+   * nearest higher within a smaller distance is the same point, or none.
+   * The results are the isSeed and clusterIndex that makeClusters() gives
+   * for each setting, while the points keep rho and the delta and
+   * nearestHigher of the largest outlierDeltaFactor.
+   */
+  std::vector<CLUEScanResult> scanClusters(const std::vector<std::pair<float, float>>& settings);
+
+  /**
+   * Clusters the points once for each of the critical distances `dcs`, with
+   * the current rhoc and outlierDeltaFactor. The tiles are searched only
+   * once, at the largest distance, and the neighbours found are stored in a
+   * compressed row table which the density, delta and cluster stages of
+   * every dc then read. The results, ordered by increasing dc, are the ones
+   * of makeClusters() for each dc and the points keep rho, delta and
+   * nearestHigher of the largest one. The neighbour table holds 8 bytes per
+   * pair within max(1, outlierDeltaFactor) * max(dcs).
+   */
+  std::vector<CLUEScanResult> scanCriticalDistances(std::vector<float> dcs);
+  const Points& getPoints() const { return points_; };
+  const CLUETimings& getTimings() const { return timings_; }
+  const CLUECounters& getCounters() const { return counters_; }
+  // whether the last makeClusters() used the neighbour cache
+  bool usedNeighbourCache() const { return usedNeighbourCache_; }
+
+  // dump index,x,y,layer,weight,rho,delta,nh,isSeed,clusterId of the first
+  // nVerbose points (all if -1) as csv, to the screen if outputFileName is "cout"
+  void verboseResults(std::string outputFileName="cout", int nVerbose=-1) const;
+  // same content in binary: the magic "CLUEVRB", a uint32 version and a
+  // uint64 number of points, followed by the x, y, layer, weight, rho,
+  // delta, nh, isSeed, clusterId columns (4 bytes per value)
+  void verboseResultsBinary(const std::string& outputFileName, int nVerbose=-1) const;
         
-private:
-  // private member methods
+protected:
+  // protected member methods, shared with the parallel kernels of CLUEAlgoParallel.h
+  void groupPointsByLayer();
   void prepareDataStructures();
   void calculateLocalDensity();
   void calculateDistanceToHigher();
+  // Nearest higher (delta, index) of the point i of layer l. The bins of the
+  // search box are visited in rings of increasing radius, starting from dc,
+  // until the radius exceeds the best delta found; equal deltas are resolved
+  // as by a full scan of the box, bin by bin and point by point
+  std::pair<float, int> searchNearestHigher(int l, int i);
+  void calculateDistanceToHigherSorted();
+  // energy prefilter: indices of the points above and below energyThreshold_
+  void filterPoints(int n, const float* weight);
+  // arrays given to clearAndSetPoints(), owned by the caller
+  struct InputArrays {
+    int n = 0;
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const int* layer = nullptr;
+    const float* weight = nullptr;
+    const float* r = nullptr;
+    const float* time = nullptr;
+  };
+  // the inputs of p are the arrays of `in`, read in place (r = 0 if there is none)
+  void setInputs(Points& p, const InputArrays& in) const;
+  // the inputs of p are copies of the ones of the points `indices` of `in`
+  void copyInputs(Points& p, const std::pmr::vector<int>& indices, const InputArrays& in) const;
+  // back to all the input points after the clustering of the ones above the threshold
+  void restoreFilteredPoints();
+  void restoreFilteredResult(CLUEScanResult& res) const;
+  // Neighbour table: the neighbours of the point layerPoints_[idx] within dc
+  // or outlierDeltaFactor_ * dc are neighbours_[neighbourOffsets_[idx]] ...
+  // neighbours_[neighbourOffsets_[idx+1]-1], with their squared distances.
+  // They are in the order in which calculateLocalDensity and
+  // calculateDistanceToHigher visit them, as the bins of a smaller search box
+  // come in the same order. Returns false, leaving the table unusable, if it
+  // would hold more than maxPairs pairs.
+  bool fillNeighbourTable(float dc, std::size_t maxPairs);
+  // same results as calculateLocalDensity and calculateDistanceToHigher, from the neighbour table
+  void calculateLocalDensityFromTable();
+  void calculateDistanceToHigherFromTable();
   void findAndAssignClusters();
-  inline float distance(int i, int j, bool isPhi = false, float r = 0.0 ) const ;
-  inline float distance2(int i, int j, bool isPhi = false, float r = 0.0) const ;
+  // with a time window, the points of every bin of the layer are sorted by time
+  void sortTilesByTime(int layer);
+  // points of a bin which can be neighbours of i: all of them, or only the
+  // ones within the time window, found by bisection in the time-sorted bin
+  std::span<const int> binCandidates(std::span<const int> bin, int i) const {
+    if(timeWindow_ <= 0.f)
+      return bin;
+    const float t_i = points_.time[i];
+    auto begin = std::upper_bound(bin.begin(), bin.end(), t_i - timeWindow_,
+                                  [&](float t, int j) { return t < points_.time[j]; });
+    auto end = std::lower_bound(begin, bin.end(), t_i + timeWindow_,
+                                [&](int j, float t) { return points_.time[j] < t; });
+    return {begin, end};
+  }
+  // shared by the scans: the points by decreasing rho, then the clusters of res from rho, delta and nearestHigher
+  void sortByDecreasingRho(std::pmr::vector<int>& byRho) const;
+  void assignScanClusters(const std::pmr::vector<int>& byRho, CLUEScanResult& res) const;
+  // points of the bin binId of layer l, in the flat tiles or in allLayerTiles_
+  std::span<const int> tileBin(int l, int binId) const {
+    if(!flatTiles_)
+      return allLayerTiles_[l][binId];
+    const int g = l * TILES::constants_type_t::nTiles + binId;
+    return {tilePoints_.data() + tileOffsets_[g], tilePoints_.data() + tileOffsets_[g + 1]};
+  }
   TILES allLayerTiles_;
+  // Flat tiles, filled by CLUEAlgoParallel_T instead of allLayerTiles_: the
+  // points of the bin g = l * nTiles + binId of layer l are
+  // tilePoints_[tileOffsets_[g]] ... tilePoints_[tileOffsets_[g+1]-1], in the
+  // order of the same bin of allLayerTiles_. They are read through tileBin.
+  bool flatTiles_ = false;
+  std::unique_ptr<int[]> tileOffsets_;
+  std::pmr::vector<int> tilePoints_;
+  // indices of the points grouped by layer: layer l owns
+  // layerPoints_[layerOffsets_[l]] ... layerPoints_[layerOffsets_[l+1]-1]
+  std::pmr::vector<int> layerOffsets_;
+  std::pmr::vector<int> layerPoints_;
+  std::pmr::vector<int> neighbourOffsets_;
+  std::pmr::vector<int> neighbours_;
+  std::pmr::vector<float> neighbourDistance2_;
+  bool usedNeighbourCache_ = false;
+  InputArrays inputs_;
+  // input index of the points kept and dropped by the energy prefilter,
+  // both empty without prefilter or once the points are restored
+  std::pmr::vector<int> keptPoints_;
+  std::pmr::vector<int> droppedPoints_;
+  // tiles of the DensitySorted engine, allocated at its first use
+  std::unique_ptr<TILES> higherTiles_;
+  std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+  const char* traceRegion_ = nullptr;
+
+private:
+  template <bool SORTED>
+  std::pair<float, int> searchNearestHigherIn(int l, int i);
+  // order of two points in a bin of allLayerTiles_
+  bool comesFirstInBin(int i, int j) const {
+    if(timeWindow_ > 0.f && points_.time[i] != points_.time[j])
+      return points_.time[i] < points_.time[j];
+    return i < j;
+  }
 
 };
 
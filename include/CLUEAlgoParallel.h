@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUEAlgoParallel_h
+#define CLUEAlgoParallel_h
+
+#include <atomic>
+#include <memory>
+
+#include "CLUEAlgo.h"
+#include "CLUEBackends.h"
+
+/**
+ * CLUE with its phases written as data-parallel kernels, run by one of the
+ * backends of CLUEBackends.h. Points, inputs and outputs are the ones of
+ * CLUEAlgo_T (the tiles are its flat tiles), and so are the results: every
+ * work item accumulates in the same order as the sequential loops and the
+ * clusters are numbered per layer in the same order, so rho, delta,
+ * nearestHigher, isSeed and clusterIndex are identical. The followers are not filled, as the clusters
+ * are assigned by following the chain of nearest highers of every point
+ * up to its seed instead of expanding the seeds.
+ * The hot-path counters are only available in CLUEAlgo_T.
+ */
+template <typename TILES, typename BACKEND>
+class CLUEAlgoParallel_T : public CLUEAlgo_T<TILES> {
+
+public:
+  using base_type = CLUEAlgo_T<TILES>;
+  using typename base_type::constants_type_t;
+  using typename base_type::geometry_type;
+  using backend_type = BACKEND;
+
+  using base_type::base_type;
+
+  void makeClusters();
+
+private:
+  // one work item per point, in several kernels, and one per layer for the offsets
+  void prepareDataStructures();
+  // one work item per point
+  void calculateLocalDensity();
+  // one work item per point
+  void calculateDistanceToHigher();
+  // one work item per layer to number the seeds, then one per point
+  void findAndAssignClusters();
+
+  // number of points of every bin of every layer, 0 outside of prepareDataStructures
+  std::unique_ptr<std::atomic<int>[]> binCounts_;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUEAlgoRegistry_h
+#define CLUEAlgoRegistry_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "CLUEAlgo.h"
+
+namespace clue {
+
+  /**
+   * Calls f(std::type_identity<ALGO>{}, name) once for every CLUEAlgo_T
+   * instantiation declared in CLUEAlgo.h. A new detector only needs to be
+   * added here to become available to the tools looping over geometries.
+   */
+  template <typename F>
+  void forEachCLUEAlgo(F&& f) {
+    f(std::type_identity<CLUEAlgo>{}, "Default");
+    f(std::type_identity<CLICdetEndcapCLUEAlgo>{}, "CLICdetEndcap");
+    f(std::type_identity<CLICdetBarrelCLUEAlgo>{}, "CLICdetBarrel");
+    f(std::type_identity<CLDEndcapCLUEAlgo>{}, "CLDEndcap");
+    f(std::type_identity<CLDBarrelCLUEAlgo>{}, "CLDBarrel");
+    f(std::type_identity<LArBarrelCLUEAlgo>{}, "LArBarrel");
+  }
+
+  /**
+   * Calls f(std::type_identity<ALGO>{}) for the instantiation registered
+   * with the given name. Returns false if the name is unknown.
+   */
+  template <typename F>
+  bool dispatchCLUEAlgo(const std::string& name, F&& f) {
+    bool found = false;
+    forEachCLUEAlgo([&](auto tag, const char* algoName) {
+      if (!found && name == algoName) {
+        found = true;
+        f(tag);
+      }
+    });
+    return found;
+  }
+
+  /**
+   * Runtime interface to the CLUEAlgo_T instantiations, for the clients
+   * which pick the geometry from their configuration.
+   */
+  class CLUEAlgoBase {
+  public:
+    virtual ~CLUEAlgoBase() = default;
+
+    // the arrays are read in place, see CLUEAlgo_T::clearAndSetPoints
+    virtual bool clearAndSetPoints(int n, const float* x, const float* y, const int* layer, const float* weight,
+                                   const float* r, const float* time = nullptr) = 0;
+    virtual void makeClusters() = 0;
+    virtual CLUEClusterMap getClusters() = 0;
+    virtual const Points& getPoints() const = 0;
+    virtual void clearLayerTiles() = 0;
+    virtual const CLUETimings& getTimings() const = 0;
+    virtual const CLUECounters& getCounters() const = 0;
+    virtual void setMemoryResource(std::pmr::memory_resource* mr) = 0;
+    virtual void setTraceRegion(const std::string& region) = 0;
+    virtual void setTimeWindow(float timeWindow) = 0;
+    // budget in bytes of the neighbour cache of makeClusters(), 0 to disable it;
+    // false (and nothing set) if the algo has no neighbour cache, as CLUEAlgoParallel_T
+    virtual bool setNeighbourCache(std::size_t bytes) = 0;
+    // see CLUEAlgo_T::capSeedDelta_; false (and nothing set) if the algo has no cap
+    virtual bool setCapSeedDelta(bool cap) = 0;
+    // false (and nothing set) if the algo only has the Tiles engine
+    virtual bool setDeltaEngine(CLUEDeltaEngine engine) = 0;
+    // see CLUEAlgo_T::energyThreshold_
+    virtual void setEnergyThreshold(float threshold) = 0;
+
+    virtual bool endcap() const = 0;
+    virtual int nLayers() const = 0;
+  };
+
+  template <typename ALGO>
+  class CLUEAlgoAdapter final : public CLUEAlgoBase {
+  public:
+    CLUEAlgoAdapter(float dc, float rhoc, float outlierDeltaFactor, bool verbose)
+        : algo_(dc, rhoc, outlierDeltaFactor, verbose) {}
+
+    bool clearAndSetPoints(int n, const float* x, const float* y, const int* layer, const float* weight,
+                           const float* r, const float* time = nullptr) override {
+      return algo_.clearAndSetPoints(n, x, y, layer, weight, r, time);
+    }
+    void makeClusters() override { algo_.makeClusters(); }
+    CLUEClusterMap getClusters() override { return algo_.getClusters(); }
+    const Points& getPoints() const override { return algo_.getPoints(); }
+    void clearLayerTiles() override { algo_.clearLayerTiles(); }
+    const CLUETimings& getTimings() const override { return algo_.getTimings(); }
+    const CLUECounters& getCounters() const override { return algo_.getCounters(); }
+    void setMemoryResource(std::pmr::memory_resource* mr) override { algo_.setMemoryResource(mr); }
+    void setTraceRegion(const std::string& region) override { algo_.setTraceRegion(region); }
+    void setTimeWindow(float timeWindow) override { algo_.timeWindow_ = timeWindow; }
+    bool setNeighbourCache(std::size_t bytes) override {
+      if (parallel && bytes > 0)
+        return false;
+      algo_.neighbourCacheBytes_ = bytes;
+      return true;
+    }
+    bool setCapSeedDelta(bool cap) override {
+      if (parallel && cap)
+        return false;
+      algo_.capSeedDelta_ = cap;
+      return true;
+    }
+    bool setDeltaEngine(CLUEDeltaEngine engine) override {
+      if (parallel && engine != CLUEDeltaEngine::Tiles)
+        return false;
+      algo_.deltaEngine_ = engine;
+      return true;
+    }
+    void setEnergyThreshold(float threshold) override { algo_.energyThreshold_ = threshold; }
+
+    bool endcap() const override { return ALGO::constants_type_t::endcap; }
+    int nLayers() const override { return ALGO::constants_type_t::nLayers; }
+
+  private:
+    // CLUEAlgoParallel_T, which only implements the default search
+    static constexpr bool parallel = requires { typename ALGO::backend_type; };
+
+    ALGO algo_;
+  };
+
+  /**
+   * Creates the CLUEAlgo_T registered with the given name in forEachCLUEAlgo,
+   * with the hot-path counters if `counters` is true. If `backend` is not
+   * empty, the CLUEAlgoParallel_T on that backend (Serial, Threads or Tbb,
+   * see CLUEBackends.h) is created instead, without counters.
+   * Returns nullptr if the name or the backend is unknown.
+   */
+  std::unique_ptr<CLUEAlgoBase> makeCLUEAlgo(const std::string& name, float dc, float rhoc, float outlierDeltaFactor,
+                                             bool verbose = false, bool counters = false,
+                                             const std::string& backend = "");
+
+  // names and backends accepted by makeCLUEAlgo
+  std::vector<std::string> clueAlgoNames();
+  std::vector<std::string> clueBackendNames();
+
+  // CLUEDeltaEngine by name (Tiles or DensitySorted), false if the name is unknown
+  bool deltaEngineFromName(const std::string& name, CLUEDeltaEngine& engine);
+  std::vector<std::string> deltaEngineNames();
+
+} // namespace clue
+
+#endif // CLUEAlgoRegistry_h
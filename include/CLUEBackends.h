@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUEBackends_h
+#define CLUEBackends_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+/**
+ * CPU backends of the parallel CLUE kernels (see CLUEAlgoParallel.h).
+ *
+ * A backend only provides parallelFor(n, kernel), which calls kernel(i) once
+ * for every i in [0, n) and returns when all of them are done. The kernels
+ * must not depend on the order of the calls, as on an accelerator, so the
+ * same kernels can later be mapped onto a GPU backend.
+ */
+namespace clue::backend {
+
+  // One work item after the other on the calling thread, for debugging and reference
+  struct Serial {
+    static constexpr const char* name = "Serial";
+
+    template <typename F>
+    static void parallelFor(int n, const F& kernel) {
+      for (int i = 0; i < n; ++i)
+        kernel(i);
+    }
+  };
+
+  /**
+   * Worker threads of the Threads backend, started once and kept for the
+   * whole program. run() hands the chunks of one kernel to the workers and
+   * to the calling thread, and returns when all of them are done; kernels
+   * launched from several threads at the same time take turns.
+   */
+  class ThreadPool {
+  public:
+    static ThreadPool& instance();
+    ~ThreadPool();
+
+    // calls chunk(context, c) once for every c in [0, nChunks), on nThreads threads
+    // including the caller; the pool is resized if nThreads changed
+    void run(int nChunks, unsigned nThreads, void (*chunk)(const void*, int), const void* context);
+
+  private:
+    ThreadPool() = default;
+    void resize(unsigned nWorkers);
+    void work();
+    void runChunks();
+
+    std::mutex runMutex_;  // one kernel at a time
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+
+    // current kernel, open while chunk_ is set; workers only join an open kernel
+    void (*chunk_)(const void*, int) = nullptr;
+    const void* context_ = nullptr;
+    int nChunks_ = 0;
+    std::atomic<int> nextChunk_{0};
+    std::uint64_t generation_ = 0;
+    int activeWorkers_ = 0;
+  };
+
+  // One contiguous chunk of work items per thread of a persistent ThreadPool
+  struct Threads {
+    static constexpr const char* name = "Threads";
+    // number of threads of a kernel, at most one per minChunk work items
+    static inline unsigned nThreads = std::max(1u, std::thread::hardware_concurrency());
+    static constexpr int minChunk = 512;
+
+    template <typename F>
+    static void parallelFor(int n, const F& kernel) {
+      const int nChunks = std::min<int>(nThreads, (n + minChunk - 1) / minChunk);
+      if (nChunks <= 1) {
+        Serial::parallelFor(n, kernel);
+        return;
+      }
+      auto runChunk = [&](int c) {
+        const int end = static_cast<long>(n) * (c + 1) / nChunks;
+        for (int i = static_cast<long>(n) * c / nChunks; i < end; ++i)
+          kernel(i);
+      };
+      ThreadPool::instance().run(
+          nChunks, nThreads,
+          [](const void* context, int c) { (*static_cast<const decltype(runChunk)*>(context))(c); }, &runChunk);
+    }
+  };
+
+  // Work items scheduled by the TBB task arena of the caller
+  struct Tbb {
+    static constexpr const char* name = "Tbb";
+    static constexpr int grainSize = 64;
+
+    template <typename F>
+    static void parallelFor(int n, const F& kernel) {
+      tbb::parallel_for(tbb::blocked_range<int>(0, n, grainSize), [&](const tbb::blocked_range<int>& range) {
+        for (int i = range.begin(); i < range.end(); ++i)
+          kernel(i);
+      });
+    }
+  };
+
+} // namespace clue::backend
+
+#endif
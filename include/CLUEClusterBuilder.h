@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUEClusterBuilder_h
+#define CLUEClusterBuilder_h
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#include <edm4hep/CalorimeterHitCollection.h>
+#include <edm4hep/ClusterCollection.h>
+
+#include "CLUEAlgo.h"
+#include "CLUEClusterPosition.h"
+
+/**
+ * Conversion of the CLUE results into EDM4hep clusters, shared by
+ * ClueGaudiAlgorithmWrapper and clue_pipeline.
+ */
+namespace clue {
+
+  /**
+   * Adds to `clusters` one cluster per CLUE cluster (outliers excluded) and
+   * per layer, made of the hits of `hits`, which were given to CLUE in the
+   * same order, with the CLUE `layer` of each hit. The positions are
+   * log-weighted with `thresholdW0`, see calculatePosition.
+   * Returns the number of clusters without energy.
+   */
+  inline int fillFinalClusters(const edm4hep::CalorimeterHitCollection& hits, std::span<const int> layer,
+                               const CLUEClusterMap& clusterMap, edm4hep::ClusterCollection& clusters,
+                               float thresholdW0 = 2.9f,
+                               std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+
+    int nZeroEnergy = 0;
+    std::pmr::map<int, std::pmr::vector<int> > clustersLayer(mr);
+    // positions and energies of the hits of a cluster, for calculatePosition
+    std::pmr::vector<float> x(mr);
+    std::pmr::vector<float> y(mr);
+    std::pmr::vector<float> z(mr);
+    std::pmr::vector<float> e(mr);
+    for(const auto& cl : clusterMap){
+
+      // Outliers should not create a cluster
+      if(cl.first == -1){
+        continue;
+      }
+
+      for(auto index : cl.second){
+        clustersLayer[layer[index]].push_back(index);
+      }
+
+      for(const auto& clLay : clustersLayer){
+
+        auto cluster = clusters.create();
+        unsigned int maxEnergyIndex = 0;
+        float maxEnergyValue = 0.f;
+
+        x.clear();
+        y.clear();
+        z.clear();
+        e.clear();
+        for(auto index : clLay.second){
+
+          const auto hit = hits.at(index);
+          cluster.addToHits(hit);
+          x.push_back(hit.getPosition().x);
+          y.push_back(hit.getPosition().y);
+          z.push_back(hit.getPosition().z);
+          e.push_back(hit.getEnergy());
+
+          if (hit.getEnergy() > maxEnergyValue) {
+            maxEnergyValue = hit.getEnergy();
+            maxEnergyIndex = index;
+          }
+        }
+        float energy = 0.f;
+        float sumEnergyErrSquared = 0.f;
+        std::for_each(cluster.getHits().begin(), cluster.getHits().end(),
+                      [&energy, &sumEnergyErrSquared] (edm4hep::CalorimeterHit elem) {
+                        energy += elem.getEnergy();
+                        sumEnergyErrSquared += pow(elem.getEnergyError()/(1.*elem.getEnergy()), 2);
+                      });
+        cluster.setEnergy(energy);
+        cluster.setEnergyError(sqrt(sumEnergyErrSquared));
+
+        nZeroEnergy += !(energy > 0.f);
+
+        ClusterPosition position;
+        if(calculatePosition(x, y, z, e, thresholdW0, position))
+          cluster.setPosition({position.x, position.y, position.z});
+        const auto& c = position.covariance;
+        cluster.setPositionError({c[0], c[1], c[2], c[3], c[4], c[5]});
+        cluster.setType(hits.at(maxEnergyIndex).getType());
+      }
+      clustersLayer.clear();
+    }
+
+    return nZeroEnergy;
+  }
+
+  // One calo hit per cluster, with the cellID of its most energetic hit and the mean time of its hits
+  inline void transformClustersInCaloHits(const edm4hep::ClusterCollection& clusters,
+                                          edm4hep::CalorimeterHitCollection& caloHits) {
+
+    float time = 0.f;
+    float maxEnergy = 0.f;
+    std::uint64_t maxEnergyCellID = 0;
+
+    for(auto cl : clusters){
+      auto caloHit = caloHits.create();
+      caloHit.setEnergy(cl.getEnergy());
+      caloHit.setEnergyError(cl.getEnergyError());
+      caloHit.setPosition(cl.getPosition());
+      caloHit.setType(cl.getType());
+
+      time = 0.0;
+      maxEnergy = 0.0;
+      maxEnergyCellID = 0;
+      for(auto hit : cl.getHits()){
+        time += hit.getTime();
+        if (hit.getEnergy() > maxEnergy) {
+          maxEnergy = hit.getEnergy();
+          maxEnergyCellID = hit.getCellID();
+        }
+      }
+      caloHit.setCellID(maxEnergyCellID);
+      caloHit.setTime(time/cl.hits_size());
+    }
+  }
+
+} // namespace clue
+
+#endif
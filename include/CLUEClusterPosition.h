@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUEClusterPosition_h
+#define CLUEClusterPosition_h
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+
+/**
+ * Position of the clusters from plain arrays of their hits, used by
+ * fillFinalClusters (CLUEClusterBuilder.h) and tested without EDM4hep.
+ */
+namespace clue {
+
+  // Log-weighted position of a cluster, with its covariance
+  struct ClusterPosition {
+    float x = 0.f;
+    float y = 0.f;
+    float z = 0.f;
+    // lower triangle of the covariance: xx, yx, yy, zx, zy, zz
+    std::array<float, 6> covariance{};
+  };
+
+  /**
+   * Log-weighted position of the hits at x, y, z with the given energies,
+   * w_i = max(thresholdW0 + log(E_i / E), 0) with E the sum of the energies,
+   * so that the hits with less than exp(-thresholdW0) of E do not contribute,
+   * and its covariance, i.e. the weighted spread of the hits divided by the
+   * effective number of hits (sum w)^2 / sum w^2.
+   * The energies are overwritten with the weights. The moments are summed in
+   * one pass over the hits, shifted to the hit of largest weight and split in
+   * lanes so that the loop vectorizes without reassociating the float sums.
+   * Returns false, leaving `position` untouched, if the hits have no energy
+   * or no weight.
+   */
+  inline bool calculatePosition(std::span<const float> x, std::span<const float> y, std::span<const float> z,
+                                std::span<float> energy, float thresholdW0, ClusterPosition& position) {
+
+    const std::size_t n = energy.size();
+    float totalEnergy = 0.f;
+    for (std::size_t i = 0; i < n; i++)
+      totalEnergy += energy[i];
+    if (!(totalEnergy > 0.f))
+      return false;
+
+    // energies to weights
+    const float logTotalEnergy = std::log(totalEnergy);
+    for (std::size_t i = 0; i < n; i++)
+      energy[i] = std::max(0.f, thresholdW0 + std::log(energy[i]) - logTotalEnergy);
+    const std::span<const float> w = energy;
+
+    constexpr std::size_t lanes = 8;
+    // sum w, w^2, w dx, w dy, w dz, w dx dx, w dy dx, w dy dy, w dz dx, w dz dy, w dz dz
+    float sums[11][lanes] = {};
+    // shifted to the hit of largest weight, which is close to the mean even if
+    // only a few hits contribute, to keep the cancellation of the spread small
+    const std::size_t i0 = std::max_element(w.begin(), w.end()) - w.begin();
+    const float x0 = x[i0];
+    const float y0 = y[i0];
+    const float z0 = z[i0];
+    // the last hits, padded with zero weights to a full block
+    const std::size_t full = n - n % lanes;
+    float tail[4][lanes] = {};
+    std::copy(x.begin() + full, x.end(), tail[0]);
+    std::copy(y.begin() + full, y.end(), tail[1]);
+    std::copy(z.begin() + full, z.end(), tail[2]);
+    std::copy(w.begin() + full, w.end(), tail[3]);
+    for (std::size_t first = 0; first < n; first += lanes) {
+      const bool last = first == full;
+      const float* bx = last ? tail[0] : x.data() + first;
+      const float* by = last ? tail[1] : y.data() + first;
+      const float* bz = last ? tail[2] : z.data() + first;
+      const float* bw = last ? tail[3] : w.data() + first;
+      for (std::size_t k = 0; k < lanes; k++) {
+        const float dx = bx[k] - x0;
+        const float dy = by[k] - y0;
+        const float dz = bz[k] - z0;
+        sums[0][k] += bw[k];
+        sums[1][k] += bw[k] * bw[k];
+        sums[2][k] += bw[k] * dx;
+        sums[3][k] += bw[k] * dy;
+        sums[4][k] += bw[k] * dz;
+        sums[5][k] += bw[k] * dx * dx;
+        sums[6][k] += bw[k] * dy * dx;
+        sums[7][k] += bw[k] * dy * dy;
+        sums[8][k] += bw[k] * dz * dx;
+        sums[9][k] += bw[k] * dz * dy;
+        sums[10][k] += bw[k] * dz * dz;
+      }
+    }
+
+    float total[11];
+    for (int m = 0; m < 11; m++) {
+      total[m] = 0.f;
+      for (std::size_t k = 0; k < lanes; k++)
+        total[m] += sums[m][k];
+    }
+    if (total[0] == 0.f)
+      return false;
+
+    const float invW = 1.f / total[0];
+    const float mx = total[2] * invW;
+    const float my = total[3] * invW;
+    const float mz = total[4] * invW;
+    position.x = x0 + mx;
+    position.y = y0 + my;
+    position.z = z0 + mz;
+
+    // spread of the hits over the effective number of hits
+    const float scale = total[1] * invW * invW;
+    position.covariance = {(total[5] * invW - mx * mx) * scale, (total[6] * invW - my * mx) * scale,
+                           (total[7] * invW - my * my) * scale, (total[8] * invW - mz * mx) * scale,
+                           (total[9] * invW - mz * my) * scale, (total[10] * invW - mz * mz) * scale};
+    return true;
+  }
+
+} // namespace clue
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUEEventFile_h
+#define CLUEEventFile_h
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clue {
+
+  /**
+   * Binary capture of the CLUE inputs, one record per event and region.
+   *
+   * Layout (native endianness, every array starts at a multiple of 64 bytes
+   * from the beginning of the file, so that a memory-mapped file can be
+   * used in place):
+   *   FileHeader
+   *   for each record:
+   *     RecordHeader
+   *     x[n], y[n], r[n] (float), layer[n] (int32), weight[n] (float)
+   */
+  namespace eventfile {
+
+    constexpr char fileMagic[8] = {'C', 'L', 'U', 'E', 'E', 'V', 'T', '\0'};
+    constexpr std::uint32_t version = 1;
+    constexpr std::size_t alignment = 64;
+
+    struct FileHeader {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t recordHeaderSize;
+    };
+
+    struct RecordHeader {
+      std::uint64_t recordSize;  // bytes, including this header and the padding
+      std::uint64_t event;
+      std::uint64_t n;
+      char region[32];
+      char geometry[32];  // name of the CLUEAlgo_T instantiation, see CLUEAlgoRegistry.h
+      float dc;
+      float rhoc;
+      float outlierDeltaFactor;
+      std::uint32_t reserved;
+    };
+
+    // longest region or geometry name of a record, longer ones are rejected by EventFileWriter::write
+    constexpr std::size_t maxNameLength = sizeof(RecordHeader::region) - 1;
+    static_assert(sizeof(RecordHeader::geometry) - 1 == maxNameLength);
+
+  } // namespace eventfile
+
+  // View on one record of a memory-mapped capture file
+  struct CapturedRegion {
+    std::uint64_t event;
+    std::string_view region;
+    std::string_view geometry;
+    float dc;
+    float rhoc;
+    float outlierDeltaFactor;
+    std::size_t n;
+    const float* x;
+    const float* y;
+    const float* r;
+    const std::int32_t* layer;
+    const float* weight;
+  };
+
+  class EventFileWriter {
+  public:
+    EventFileWriter() = default;
+    explicit EventFileWriter(const std::string& fileName) { open(fileName); }
+
+    bool open(const std::string& fileName);
+    bool isOpen() const { return file_.is_open(); }
+    void close() { file_.close(); }
+
+    // thread safe: records written concurrently are serialised; returns false
+    // without writing anything if region or geometry is longer than maxNameLength
+    bool write(std::uint64_t event, const std::string& region, const std::string& geometry, float dc, float rhoc,
+               float outlierDeltaFactor, std::size_t n, const float* x, const float* y, const float* r,
+               const int* layer, const float* weight);
+
+  private:
+    std::ofstream file_;
+    std::mutex mutex_;
+  };
+
+  class EventFileReader {
+  public:
+    EventFileReader() = default;
+    explicit EventFileReader(const std::string& fileName) { open(fileName); }
+    ~EventFileReader() { close(); }
+    EventFileReader(const EventFileReader&) = delete;
+    EventFileReader& operator=(const EventFileReader&) = delete;
+
+    // maps the file and indexes its records, returns false if it is not a valid capture
+    bool open(const std::string& fileName);
+    void close();
+
+    std::size_t size() const { return records_.size(); }
+    const CapturedRegion& operator[](std::size_t i) const { return records_[i]; }
+    auto begin() const { return records_.begin(); }
+    auto end() const { return records_.end(); }
+
+  private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::vector<CapturedRegion> records_;
+  };
+
+} // namespace clue
+
+#endif // CLUEEventFile_h
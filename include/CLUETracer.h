@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLUETracer_h
+#define CLUETracer_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clue {
+
+  /**
+   * Low-overhead recorder of begin/end (complete) events, dumped as a
+   * Chrome trace JSON file that can be opened with chrome://tracing or
+   * https://ui.perfetto.dev.
+   * Each thread records into its own buffer, so recording does not lock.
+   * When the tracer is disabled a TraceScope costs one relaxed atomic load.
+   * Names, categories and regions must outlive the tracer: use string
+   * literals or strings returned by intern().
+   */
+  class Tracer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+      const char* name;
+      const char* category;
+      const char* region;
+      int layer;
+      std::int64_t begin;  // [ns] since the tracer creation
+      std::int64_t duration;  // [ns]
+    };
+
+    static Tracer& instance();
+
+    void enable(bool enabled = true) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // returns a pointer to a copy of s which stays valid as long as the tracer
+    const char* intern(const std::string& s);
+
+    void record(const char* name, const char* category, Clock::time_point begin, Clock::time_point end,
+                const char* region = nullptr, int layer = -1);
+
+    // must not be called while other threads are recording
+    bool dump(const std::string& fileName) const;
+    void clear();
+
+    std::size_t size() const;
+    std::size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // per-thread cap on the number of recorded events
+    static constexpr std::size_t maxEventsPerThread = 1 << 22;
+
+  private:
+    struct ThreadBuffer {
+      unsigned tid;
+      std::vector<Event> events;
+    };
+
+    Tracer() : start_(Clock::now()) {}
+    ThreadBuffer& threadBuffer();
+
+    Clock::time_point start_;
+    std::atomic<bool> enabled_{false};
+    std::atomic<std::size_t> dropped_{0};
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::set<std::string> strings_;
+  };
+
+  // Records an event spanning the lifetime of the object
+  class TraceScope {
+  public:
+    TraceScope(const char* name, const char* category, const char* region = nullptr, int layer = -1)
+      : name_(name), category_(category), region_(region), layer_(layer), active_(Tracer::instance().enabled()) {
+      if (active_)
+        begin_ = Tracer::Clock::now();
+    }
+    ~TraceScope() {
+      if (active_)
+        Tracer::instance().record(name_, category_, begin_, Tracer::Clock::now(), region_, layer_);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+  private:
+    const char* name_;
+    const char* category_;
+    const char* region_;
+    int layer_;
+    bool active_;
+    Tracer::Clock::time_point begin_;
+  };
+
+} // namespace clue
+
+#endif // CLUETracer_h
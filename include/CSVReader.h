@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CSVReader_h
+#define CSVReader_h
+
+#include <string>
+
+#include "InputPoints.h"
+
+namespace clue {
+
+  /**
+   * Reads a csv file with the columns x,y,layer,weight and an optional
+   * fifth column r (needed by the barrel geometries) into points.
+   * A header line, if present, is skipped. When r is not given it is set to 0.
+   *
+   * The file is memory-mapped and parsed with std::from_chars; with
+   * nThreads > 1 it is split in chunks at line boundaries which are parsed
+   * in parallel directly into their final position in the output arrays.
+   *
+   * With nLayerCopies > 1 the points are replicated nLayerCopies times,
+   * copy l being shifted by l layers, i.e. the output holds
+   * nLayerCopies * nRows points.
+   *
+   * Returns false (and prints the reason on std::cerr) on errors.
+   */
+  bool readCSV(const std::string& fileName, InputPoints& points, int nLayerCopies = 1, unsigned nThreads = 1);
+
+} // namespace clue
+
+#endif // CSVReader_h
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CellIDDecoder_h
+#define CellIDDecoder_h
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clue {
+
+  /**
+   * Decoder of the DD4hep cellID encoding strings, e.g.
+   * "system:0:5,side:5:-2,module:7:8,stave:15:4,layer:19:9",
+   * for the tools which do not link against DD4hep.
+   * Fields are "name:width" (placed after the previous one) or
+   * "name:offset:width"; a negative width means a signed field.
+   * Same results as dd4hep::DDSegmentation::BitFieldCoder::get.
+   */
+  class CellIDDecoder {
+  public:
+    // throws std::invalid_argument if the string cannot be parsed
+    explicit CellIDDecoder(std::string_view encoding);
+
+    // index of the field `name`, -1 if there is no such field
+    int index(std::string_view name) const;
+
+    std::int64_t get(std::uint64_t cellID, int index) const {
+      const auto& f = fields_[index];
+      std::uint64_t value = (cellID >> f.offset) & f.mask;
+      if (f.isSigned && (value >> (f.width - 1)) & 1)
+        value |= ~f.mask;
+      return static_cast<std::int64_t>(value);
+    }
+
+    // throws std::out_of_range if there is no such field
+    std::int64_t get(std::uint64_t cellID, std::string_view name) const;
+
+  private:
+    struct Field {
+      std::string name;
+      unsigned offset;
+      unsigned width;
+      bool isSigned;
+      std::uint64_t mask;
+    };
+
+    std::vector<Field> fields_;
+  };
+
+} // namespace clue
+
+#endif
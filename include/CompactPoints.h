@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CompactPoints_h
+#define CompactPoints_h
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "InputPoints.h"
+
+namespace clue {
+
+  // IEEE binary16, rounded to nearest even
+  inline std::uint16_t floatToHalf(float f) {
+    const std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+    const std::uint32_t sign = (x >> 16) & 0x8000u;
+    const std::uint32_t absx = x & 0x7fffffffu;
+    if (absx >= 0x7f800000u)  // inf or nan
+      return sign | 0x7c00u | (absx > 0x7f800000u ? 0x200u : 0u);
+    if (absx >= 0x477ff000u)  // rounds beyond 65504
+      return sign | 0x7c00u;
+    if (absx < 0x38800000u)  // subnormal: multiples of 2^-24
+      return sign | static_cast<std::uint32_t>(std::nearbyint(std::bit_cast<float>(absx) * 16777216.f));
+    std::uint32_t h = (absx - 0x38000000u) >> 13;
+    const std::uint32_t rest = absx & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (h & 1u)))
+      ++h;
+    return sign | h;
+  }
+
+  inline float halfToFloat(std::uint16_t h) {
+    const std::uint32_t sign = (h & 0x8000u) << 16;
+    const std::uint32_t exponent = (h >> 10) & 0x1fu;
+    const std::uint32_t mantissa = h & 0x3ffu;
+    if (exponent == 0) {
+      const float f = mantissa * (1.f / 16777216.f);
+      return sign ? -f : f;
+    }
+    if (exponent == 31)
+      return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13));
+    return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+  }
+
+  // upper half of a float, rounded to nearest even
+  inline std::uint16_t floatToBFloat16(float f) {
+    std::uint32_t x = std::bit_cast<std::uint32_t>(f);
+    if ((x & 0x7fffffffu) > 0x7f800000u)
+      return (x >> 16) | 0x40u;
+    x += 0x7fffu + ((x >> 16) & 1u);
+    return x >> 16;
+  }
+
+  inline float bfloat16ToFloat(std::uint16_t h) { return std::bit_cast<float>(std::uint32_t(h) << 16); }
+
+  enum class WeightFormat { Float32, Float16, BFloat16 };
+
+  /**
+   * Compact storage of the points of one event for the detector described
+   * by the layer tiles constants T.
+   * The points are grouped by cell (layer, x bin, y bin of the T grid) and
+   * x, y are stored as int16 offsets from the centre of their cell, in units
+   * of `resolution`: they are exact to resolution/2 as long as the point is
+   * inside the tiled area (points outside it are clamped, see nSaturated).
+   * For barrel geometries r is stored in the same way, relative to a
+   * reference radius per layer; for endcaps it is recomputed from x and y.
+   * The layer takes 8 bits when the geometry has at most 256 layers, the
+   * weight 16 bits unless Float32 is requested, and the seed/outlier flags
+   * of the clustering one byte.
+   * The CLUE kernels run on floats: use decompress() to feed CLUEAlgo_T.
+   */
+  template <typename T>
+  class CompactPoints {
+  public:
+    using layer_type = std::conditional_t<(T::nLayers <= 256), std::uint8_t, std::uint16_t>;
+    enum Flags : std::uint8_t { seed = 1, outlier = 2 };
+
+    static constexpr float cellSizeX = 1.f / T::rX;
+    static constexpr float cellSizeY = 1.f / T::rY;
+    static_assert(std::uint64_t(T::nLayers) * T::nColumns * T::nRows <= UINT32_MAX);
+
+    explicit CompactPoints(float resolution = 0.01f, WeightFormat weightFormat = WeightFormat::Float16)
+        : resolution_(resolution), invResolution_(1.f / resolution), weightFormat_(weightFormat) {
+      if (0.5f * std::max(cellSizeX, cellSizeY) * invResolution_ > INT16_MAX)
+        throw std::invalid_argument("CompactPoints: resolution too small for the cell size of the geometry");
+    }
+
+    // P is any structure of arrays with x, y, r, layer and weight (InputPoints, Points)
+    template <typename P>
+    void compress(const P& points, std::size_t n) {
+      clear();
+      std::vector<std::uint32_t> cells(n);
+      for (std::size_t i = 0; i < n; ++i)
+        cells[i] = cellOf(points.x[i], points.y[i], points.layer[i]);
+      index_.resize(n);
+      std::iota(index_.begin(), index_.end(), 0u);
+      std::stable_sort(index_.begin(), index_.end(), [&](auto a, auto b) { return cells[a] < cells[b]; });
+
+      if constexpr (!T::endcap) {
+        // reference radius of a layer: the one of its first point
+        layerR_.assign(T::nLayers, 0.f);
+        std::vector<char> seen(T::nLayers, 0);
+        for (std::size_t i = 0; i < n; ++i) {
+          const int l = clampedLayer(points.layer[i]);
+          if (!seen[l]) {
+            seen[l] = 1;
+            layerR_[l] = points.r[i];
+          }
+        }
+      }
+
+      dx_.resize(n);
+      dy_.resize(n);
+      layer_.resize(n);
+      if constexpr (!T::endcap)
+        dr_.resize(n);
+      for (std::size_t k = 0; k < n; ++k) {
+        const auto i = index_[k];
+        const auto cell = cells[i];
+        if (cellId_.empty() || cellId_.back() != cell) {
+          cellId_.push_back(cell);
+          cellBegin_.push_back(k);
+        }
+        const int l = clampedLayer(points.layer[i]);
+        const int xBin = cell % T::nColumns;
+        const int yBin = (cell / T::nColumns) % T::nRows;
+        dx_[k] = quantize(points.x[i] - cellCentreX(xBin));
+        dy_[k] = quantize(points.y[i] - cellCentreY(yBin));
+        layer_[k] = l;
+        if constexpr (!T::endcap)
+          dr_[k] = quantize(points.r[i] - layerR_[l]);
+      }
+      cellBegin_.push_back(n);
+
+      switch (weightFormat_) {
+        case WeightFormat::Float32:
+          weight32_.resize(n);
+          for (std::size_t k = 0; k < n; ++k)
+            weight32_[k] = points.weight[index_[k]];
+          break;
+        case WeightFormat::Float16:
+          weight16_.resize(n);
+          for (std::size_t k = 0; k < n; ++k)
+            weight16_[k] = floatToHalf(points.weight[index_[k]]);
+          break;
+        case WeightFormat::BFloat16:
+          weight16_.resize(n);
+          for (std::size_t k = 0; k < n; ++k)
+            weight16_[k] = floatToBFloat16(points.weight[index_[k]]);
+          break;
+      }
+      flags_.assign(n, 0);
+    }
+
+    template <typename P>
+    void compress(const P& points) {
+      compress(points, points.x.size());
+    }
+
+    // packs the seed/outlier flags of the clustering results of the same points
+    template <typename P>
+    void setFlags(const P& results) {
+      for (std::size_t k = 0; k < size(); ++k) {
+        const auto i = index_[k];
+        flags_[k] = (results.isSeed[i] ? seed : 0) | (results.clusterIndex[i] < 0 ? outlier : 0);
+      }
+    }
+
+    // restores the points in their original order
+    void decompress(InputPoints& points) const {
+      const std::size_t n = size();
+      points.clear();
+      points.x.resize(n);
+      points.y.resize(n);
+      points.r.resize(n);
+      points.layer.resize(n);
+      points.weight.resize(n);
+      for (std::size_t c = 0; c < cellId_.size(); ++c) {
+        const int xBin = cellId_[c] % T::nColumns;
+        const int yBin = (cellId_[c] / T::nColumns) % T::nRows;
+        const float x0 = cellCentreX(xBin);
+        const float y0 = cellCentreY(yBin);
+        for (auto k = cellBegin_[c]; k < cellBegin_[c + 1]; ++k) {
+          const auto i = index_[k];
+          // the rounding must not push the points of the border cells out of the tiled area
+          points.x[i] = std::clamp(x0 + dx_[k] * resolution_, T::minX, T::maxX);
+          points.y[i] = std::clamp(y0 + dy_[k] * resolution_, T::minY, T::maxY);
+          points.layer[i] = layer_[k];
+          points.weight[i] = weight(k);
+          if constexpr (T::endcap)
+            points.r[i] = std::sqrt(points.x[i] * points.x[i] + points.y[i] * points.y[i]);
+          else
+            points.r[i] = layerR_[layer_[k]] + dr_[k] * resolution_;
+        }
+      }
+    }
+
+    void clear() {
+      cellId_.clear();
+      cellBegin_.clear();
+      dx_.clear();
+      dy_.clear();
+      dr_.clear();
+      layer_.clear();
+      weight16_.clear();
+      weight32_.clear();
+      flags_.clear();
+      index_.clear();
+      layerR_.clear();
+      nSaturated_ = 0;
+    }
+
+    std::size_t size() const { return index_.size(); }
+    std::size_t nCells() const { return cellId_.size(); }
+    // number of coordinates clamped because out of the int16 range
+    std::size_t nSaturated() const { return nSaturated_; }
+    float resolution() const { return resolution_; }
+
+    // accessors in storage order (grouped by cell), i.e. for k in [0, size())
+    float weight(std::size_t k) const {
+      switch (weightFormat_) {
+        case WeightFormat::Float16:
+          return halfToFloat(weight16_[k]);
+        case WeightFormat::BFloat16:
+          return bfloat16ToFloat(weight16_[k]);
+        default:
+          return weight32_[k];
+      }
+    }
+    int layer(std::size_t k) const { return layer_[k]; }
+    bool isSeed(std::size_t k) const { return flags_[k] & seed; }
+    bool isOutlier(std::size_t k) const { return flags_[k] & outlier; }
+    std::uint32_t originalIndex(std::size_t k) const { return index_[k]; }
+
+    std::size_t bytes() const {
+      return cellId_.size() * sizeof(std::uint32_t) + cellBegin_.size() * sizeof(std::uint32_t) +
+             (dx_.size() + dy_.size() + dr_.size()) * sizeof(std::int16_t) + layer_.size() * sizeof(layer_type) +
+             weight16_.size() * sizeof(std::uint16_t) + weight32_.size() * sizeof(float) + flags_.size() +
+             index_.size() * sizeof(std::uint32_t) + layerR_.size() * sizeof(float);
+    }
+
+  private:
+    static int clampedLayer(int layer) { return std::clamp(layer, 0, T::nLayers - 1); }
+    static int xBinOf(float x) { return std::clamp(int((x - T::minX) * T::rX), 0, T::nColumns - 1); }
+    static int yBinOf(float y) { return std::clamp(int((y - T::minY) * T::rY), 0, T::nRows - 1); }
+    static float cellCentreX(int xBin) { return T::minX + (xBin + 0.5f) * cellSizeX; }
+    static float cellCentreY(int yBin) { return T::minY + (yBin + 0.5f) * cellSizeY; }
+
+    static std::uint32_t cellOf(float x, float y, int layer) {
+      return (std::uint32_t(clampedLayer(layer)) * T::nRows + yBinOf(y)) * T::nColumns + xBinOf(x);
+    }
+
+    std::int16_t quantize(float offset) {
+      const float q = std::nearbyint(offset * invResolution_);
+      if (q > INT16_MAX || q < INT16_MIN) {
+        ++nSaturated_;
+        return q > 0 ? INT16_MAX : INT16_MIN;
+      }
+      return static_cast<std::int16_t>(q);
+    }
+
+    float resolution_;
+    float invResolution_;
+    WeightFormat weightFormat_;
+    std::size_t nSaturated_ = 0;
+
+    // non-empty cells (layer, y bin, x bin) in increasing order, and the range of their points
+    std::vector<std::uint32_t> cellId_;
+    std::vector<std::uint32_t> cellBegin_;
+
+    std::vector<std::int16_t> dx_;
+    std::vector<std::int16_t> dy_;
+    std::vector<std::int16_t> dr_;
+    std::vector<layer_type> layer_;
+    std::vector<std::uint16_t> weight16_;
+    std::vector<float> weight32_;
+    std::vector<std::uint8_t> flags_;
+    std::vector<std::uint32_t> index_;
+    std::vector<float> layerR_;
+  };
+
+} // namespace clue
+
+#endif // CompactPoints_h
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef EventArena_h
+#define EventArena_h
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+namespace clue {
+
+  // memory resource forwarding to `upstream` and counting what reaches it
+  class CountingResource : public std::pmr::memory_resource {
+  public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : upstream_(upstream) {}
+
+    std::size_t allocations() const { return allocations_; }
+    std::size_t bytes() const { return bytes_; }
+
+  private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::pmr::memory_resource* upstream_;
+    std::size_t allocations_ = 0;
+    std::size_t bytes_ = 0;
+  };
+
+  /**
+   * Per-event monotonic arena. Everything allocated from resource() during
+   * an event is given back at once by reset(), which costs O(1).
+   * What does not fit in the arena buffer is taken from the heap and
+   * counted; the buffer then grows at the next reset() to the high-water
+   * mark, so that in steady state no allocation reaches the heap.
+   * The users of resource() must drop their memory before reset() (see
+   * CLUEAlgo_T::setMemoryResource); the pointer stays valid across resets.
+   * Not thread safe: use one arena per thread (or event slot).
+   */
+  class EventArena {
+  public:
+    explicit EventArena(std::size_t initialSize = 1 << 20);
+    EventArena(const EventArena&) = delete;
+    EventArena& operator=(const EventArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*arena_; }
+    void reset();
+
+    std::size_t capacity() const { return size_; }
+    // allocations which did not fit in the arena, since its creation
+    std::size_t heapAllocations() const { return heap_.allocations(); }
+    std::size_t heapBytes() const { return heap_.bytes(); }
+    // number of resets after which the buffer had to grow
+    std::size_t growths() const { return growths_; }
+
+  private:
+    CountingResource heap_;
+    std::size_t size_;
+    std::unique_ptr<std::byte[]> buffer_;
+    std::optional<std::pmr::monotonic_buffer_resource> arena_;
+    std::size_t heapBytesAtReset_ = 0;
+    std::size_t growths_ = 0;
+  };
+
+} // namespace clue
+
+#endif // EventArena_h
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef EventGenerator_h
+#define EventGenerator_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+
+#include "InputPoints.h"
+#include "constexpr_cmath.h"
+
+namespace clue {
+
+  struct GeneratorConfig {
+    std::size_t nHits = 1000;     // total number of hits (showers + noise)
+    float noiseFraction = 0.2f;   // fraction of nHits spread uniformly over the detector
+    int hitsPerShower = 200;      // number of hits per shower
+    float showerEnergy = 10.f;    // mean shower energy [GeV]
+    float lateralSpread = 20.f;   // scale of the exponential lateral profile [mm]
+    float noiseEnergy = 1.e-4f;   // mean energy of a noise hit [GeV]
+    std::uint64_t seed = 42;
+  };
+
+  /**
+   * Radius assigned to the layers of a barrel geometry. The tiles only know
+   * the r*phi extension of the detector, so the outermost layer is placed
+   * just inside maxX/pi and the layers are spread over 15% of that radius.
+   */
+  template <typename T>
+  constexpr float barrelLayerRadius(int layer) {
+    constexpr float rOuter = 0.95f * T::maxX * M_1_PI;
+    constexpr float rInner = 0.85f * rOuter;
+    return rInner + (rOuter - rInner) * layer / T::nLayers;
+  }
+
+  /**
+   * Fills `points` with a synthetic event for the detector described by the
+   * layer tiles constants T: electromagnetic-like showers (gamma longitudinal
+   * profile, exponential lateral profile) on top of uniform noise.
+   * Endcap geometries are filled in (x, y), barrel ones in (r*phi, z) and
+   * r is set consistently in both cases. The hits are shuffled, so that
+   * the memory layout does not follow the shower structure.
+   */
+  template <typename T>
+  void generateEvent(const GeneratorConfig& cfg, InputPoints& points) {
+    points.clear();
+    points.reserve(cfg.nHits);
+
+    std::mt19937_64 rng(cfg.seed);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    std::exponential_distribution<float> exponential(1.f);
+    std::gamma_distribution<float> depth(3.f, std::max(1.f, T::nLayers / 12.f));
+
+    // keep the showers away from the borders of the tiles
+    const float margin = 5.f * cfg.lateralSpread;
+    auto inRange = [&](float min, float max) {
+      return min + margin + (max - min - 2.f * margin) * uniform(rng);
+    };
+    auto push = [&](float x, float y, float r, int layer, float weight) {
+      points.x.push_back(x);
+      points.y.push_back(y);
+      points.r.push_back(r);
+      points.layer.push_back(layer);
+      points.weight.push_back(weight);
+    };
+
+    const std::size_t nNoise = cfg.nHits * cfg.noiseFraction;
+    const std::size_t nShowerHits = cfg.nHits - nNoise;
+    const std::size_t hitsPerShower = std::max(1, cfg.hitsPerShower);
+
+    float x0 = 0.f, y0 = 0.f, phi0 = 0.f, eHit = 0.f;
+    int firstLayer = 0;
+    for (std::size_t i = 0; i < nShowerHits; ++i) {
+      if (i % hitsPerShower == 0) {
+        // start a new shower
+        firstLayer = static_cast<int>(0.3f * T::nLayers * uniform(rng));
+        eHit = cfg.showerEnergy * (0.5f + uniform(rng)) / hitsPerShower;
+        if constexpr (T::endcap) {
+          x0 = inRange(T::minX, T::maxX);
+          y0 = inRange(T::minY, T::maxY);
+        } else {
+          phi0 = -M_PI + 2.f * M_PI * uniform(rng);
+          y0 = inRange(T::minY, T::maxY);
+        }
+      }
+
+      const int layer = std::min(firstLayer + static_cast<int>(depth(rng)), T::nLayers - 1);
+      const float d = cfg.lateralSpread * exponential(rng);
+      const float alpha = 2.f * M_PI * uniform(rng);
+      const float weight = eHit * exponential(rng) * std::exp(-d / cfg.lateralSpread);
+      const float dx = d * std::cos(alpha);
+      const float dy = std::clamp(y0 + d * std::sin(alpha), T::minY, T::maxY);
+      if constexpr (T::endcap) {
+        const float x = std::clamp(x0 + dx, T::minX, T::maxX);
+        push(x, dy, std::sqrt(x * x + dy * dy), layer, weight);
+      } else {
+        const float r = barrelLayerRadius<T>(layer);
+        push(r * reco::normalizedPhi(phi0 + dx / r), dy, r, layer, weight);
+      }
+    }
+
+    for (std::size_t i = 0; i < nNoise; ++i) {
+      const int layer = std::min(static_cast<int>(T::nLayers * uniform(rng)), T::nLayers - 1);
+      const float weight = cfg.noiseEnergy * exponential(rng);
+      const float y = T::minY + (T::maxY - T::minY) * uniform(rng);
+      if constexpr (T::endcap) {
+        const float x = T::minX + (T::maxX - T::minX) * uniform(rng);
+        push(x, y, std::sqrt(x * x + y * y), layer, weight);
+      } else {
+        const float r = barrelLayerRadius<T>(layer);
+        push(r * static_cast<float>(-M_PI + 2. * M_PI * uniform(rng)), y, r, layer, weight);
+      }
+    }
+
+    // shuffle the hits, as the readout order has nothing to do with showers
+    std::vector<std::size_t> order(points.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+    InputPoints shuffled;
+    shuffled.reserve(order.size());
+    for (auto i : order) {
+      shuffled.x.push_back(points.x[i]);
+      shuffled.y.push_back(points.y[i]);
+      shuffled.r.push_back(points.r[i]);
+      shuffled.layer.push_back(points.layer[i]);
+      shuffled.weight.push_back(points.weight[i]);
+    }
+    points = std::move(shuffled);
+  }
+
+} // namespace clue
+
+#endif // EventGenerator_h
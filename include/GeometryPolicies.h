@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GeometryPolicies_h
+#define GeometryPolicies_h
+
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <type_traits>
+#include <vector>
+
+#include "Points.h"
+#include "constexpr_cmath.h"
+
+namespace clue {
+
+  /**
+   * Geometry policies: how the points of a layer are binned in the tiles,
+   * which bins are searched around a point and how the distance between two
+   * points of the same layer is measured. CLUEAlgo_T and LayerTiles_T only
+   * go through the policy selected for their layer tiles constants, so the
+   * instantiated kernels contain no geometry branches.
+   *
+   * A new geometry only needs a new policy, selected by adding
+   *   using geometry_type = MyGeometry;
+   * to its layer tiles constants. For instance, a hexagonal-cell policy
+   * would bin the cell centres on the hexagonal lattice in globalBin,
+   * return the range of lattice rows and columns within d in searchBox
+   * (binId then maps a lattice cell to its tile) and keep the euclidean
+   * distance2 of PlanarGeometry.
+   */
+  template <typename G>
+  concept GeometryPolicy = requires(const Points& p, int i, float d) {
+    { G::needsRadius } -> std::convertible_to<bool>;
+    { G::preparePoints(std::declval<Points&>()) };
+    { G::distance2(p, i, i) } -> std::same_as<float>;
+  };
+
+  // points on (x, y) planes, tiled in x and y
+  struct PlanarGeometry {
+    static constexpr bool needsRadius = false;
+
+    static void preparePoints(Points&) {}
+
+    template <typename LT>
+    static int globalBin(const LT& lt, float x, float y, float) {
+      return lt.getGlobalBin(x, y);
+    }
+
+    template <typename LT>
+    static int globalBin(const LT& lt, const Points& p, int i) {
+      return lt.getGlobalBin(p.x[i], p.y[i]);
+    }
+
+    template <typename LT>
+    static std::array<int, 4> searchBox(const LT& lt, const Points& p, int i, float d) {
+      return lt.searchBox(p.x[i] - d, p.x[i] + d, p.y[i] - d, p.y[i] + d);
+    }
+
+    template <typename LT>
+    static int binId(const LT& lt, int xBin, int yBin) {
+      return lt.getGlobalBinByBin(xBin, yBin);
+    }
+
+    // the float arithmetic of the original code, as every policy must keep
+    static float distance2(const Points& p, int i, int j) {
+      const float dx = p.x[i] - p.x[j];
+      const float dy = p.y[i] - p.y[j];
+      return dx * dx + dy * dy;
+    }
+  };
+
+  // points on cylinders, x = r*phi and y = z, tiled in phi and z
+  struct CylindricalGeometry {
+    static constexpr bool needsRadius = true;
+
+    // phi is kept as x / r, not brought back to [-pi, pi]: across the +-pi seam the
+    // difference of two normalized angles would lose the precision of phi, and the
+    // tiles normalize it anyway
+    static void preparePoints(Points& p) {
+      p.phi.resize(p.n);
+      p.invR.resize(p.n);
+      for (std::size_t i = 0; i < p.n; ++i) {
+        p.invR[i] = 1.f / p.r[i];
+        p.phi[i] = p.x[i] / p.r[i];
+      }
+    }
+
+    template <typename LT>
+    static int globalBin(const LT& lt, float, float y, float phi) {
+      return lt.getGlobalBinPhi(phi, y);
+    }
+
+    template <typename LT>
+    static int globalBin(const LT& lt, const Points& p, int i) {
+      return lt.getGlobalBinPhi(p.phi[i], p.y[i]);
+    }
+
+    template <typename LT>
+    static std::array<int, 4> searchBox(const LT& lt, const Points& p, int i, float d) {
+      const float dPhi = d * p.invR[i];
+      return lt.searchBoxPhiZ(p.phi[i] - dPhi, p.phi[i] + dPhi, p.y[i] - d, p.y[i] + d);
+    }
+
+    // a phi window crossing +-pi continues past the last column, bring it back
+    template <typename LT>
+    static int binId(const LT& lt, int xBin, int yBin) {
+      constexpr int nColumnsPhi = LT::type::nColumnsPhi;
+      return lt.getGlobalBinByBinPhi(xBin - (xBin >= nColumnsPhi) * nColumnsPhi, yBin);
+    }
+
+    // arc length measured on the cylinder of the first point, the same float
+    // arithmetic as reco::deltaPhi(x_i / r_i, x_j / r_j)
+    static float distance2(const Points& p, int i, int j) {
+      const float drphi = p.r[i] * reco::deltaPhiNormalized(p.phi[i], p.phi[j]);
+      const float dy = p.y[i] - p.y[j];
+      return dy * dy + drphi * drphi;
+    }
+  };
+
+  template <typename T>
+  constexpr auto selectGeometry() {
+    if constexpr (requires { typename T::geometry_type; })
+      return std::type_identity<typename T::geometry_type>{};
+    else if constexpr (T::endcap)
+      return std::type_identity<PlanarGeometry>{};
+    else
+      return std::type_identity<CylindricalGeometry>{};
+  }
+
+  // geometry policy of the layer tiles constants T
+  template <typename T>
+  using geometry_t = typename decltype(selectGeometry<T>())::type;
+
+} // namespace clue
+
+#endif // GeometryPolicies_h
@@ -31,6 +31,8 @@
 // podio specific includes
 #include "DDSegmentation/BitFieldCoder.h"
 
+#include "CSVReader.h"
+
 void read_EDM4HEP_event(const edm4hep::CalorimeterHitCollection& calo_coll, std::string cellIDstr,
                         std::vector<float>& x, std::vector<float>& y, std::vector<int>& layer, std::vector<float>& weight) {
 
@@ -58,31 +60,20 @@ void read_EDM4HEP_event(const edm4hep::CalorimeterHitCollection& calo_coll, std:
   return;
 }
 
-void read_from_csv(const std::string& inputFileName,
-                   std::vector<float>& x, std::vector<float>& y, std::vector<int>& layer, std::vector<float>& weight) {
+// Loads a standalone csv input (x,y,layer,weight), replicating the points
+// on nLayerCopies consecutive layers. See clue::readCSV in CSVReader.h.
+inline void read_from_csv(const std::string& inputFileName,
+                          std::vector<float>& x, std::vector<float>& y, std::vector<int>& layer, std::vector<float>& weight,
+                          int nLayerCopies = 10, unsigned nThreads = 1) {
 
-  std::cout<<"input csv file: "<<inputFileName<<std::endl;
-  // open csv file
-  std::ifstream iFile(inputFileName);
-  if( !iFile.is_open() ){
-    std::cerr << "ERROR: Failed to open the file" << std::endl;
+  clue::InputPoints points;
+  if (!clue::readCSV(inputFileName, points, nLayerCopies, nThreads))
     return;
-  }
-
-  // make dummy layers
-  for (int l=0; l<10; l++){
-    std::string value = "";
-    // Iterate through each line and split the content using delimeter
-    while (getline(iFile, value, ',')) {
-      x.push_back(std::stof(value)) ;
-      getline(iFile, value, ','); y.push_back(std::stof(value));
-      getline(iFile, value, ','); layer.push_back(std::stoi(value) + l);
-      getline(iFile, value); weight.push_back(std::stof(value));
-    }
-  }
-  std::cout << "Finished loading input points" << std::endl;
 
-  iFile.close();
+  x = std::move(points.x);
+  y = std::move(points.y);
+  layer = std::move(points.layer);
+  weight = std::move(points.weight);
   return;
 }
 
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef InputPoints_h
+#define InputPoints_h
+
+#include <vector>
+#include <cstddef>
+
+namespace clue {
+
+  // Structure of arrays holding the CLUE inputs of one event (or region),
+  // in the layout expected by CLUEAlgo_T::clearAndSetPoints
+  struct InputPoints {
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> r;
+    std::vector<int> layer;
+    std::vector<float> weight;
+
+    std::size_t size() const { return x.size(); }
+
+    void reserve(std::size_t n) {
+      x.reserve(n);
+      y.reserve(n);
+      r.reserve(n);
+      layer.reserve(n);
+      weight.reserve(n);
+    }
+
+    void clear() {
+      x.clear();
+      y.clear();
+      r.clear();
+      layer.clear();
+      weight.clear();
+    }
+  };
+
+} // namespace clue
+
+#endif // InputPoints_h
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace clue {
+
+  /**
+   * Histogram of latencies in nanoseconds with a fixed memory use, in the
+   * style of HdrHistogram: the values below 2^subBits have their own bin,
+   * every larger power of two is split in 2^subBits bins, so that any value
+   * is known to 1/2^subBits (3%). Values above 2^maxBits ns (73 minutes)
+   * go to the last bin.
+   * record() is lock free and can be called from several threads.
+   */
+  class LatencyHistogram {
+  public:
+    static constexpr int subBits = 5;
+    static constexpr int maxBits = 42;
+    static constexpr std::size_t nBins = std::size_t(maxBits - subBits + 1) << subBits;
+
+    void record(std::uint64_t ns);
+    // `ms` rounded to the nanosecond
+    void recordMs(double ms);
+    void reset();
+
+    std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+    // value below which a fraction q of the entries lies, i.e. the upper edge of
+    // the bin where it falls (capped to max()), 0 if there are no entries
+    std::uint64_t percentile(double q) const;
+
+    // bin of a value and highest value of a bin
+    static std::size_t binOf(std::uint64_t ns);
+    static std::uint64_t binUpperEdge(std::size_t bin);
+
+  private:
+    std::array<std::atomic<std::uint64_t>, nBins> bins_{};
+    std::atomic<std::uint64_t> count_ = 0;
+    std::atomic<std::uint64_t> sum_ = 0;
+    std::atomic<std::uint64_t> max_ = 0;
+  };
+
+} // namespace clue
+
+#endif // LatencyHistogram_h
@@ -26,6 +26,7 @@
 #include <cassert>
 #include <iostream>
 
+#include "GeometryPolicies.h"
 #include "LayerTilesConstants.h"
 #include "CLICdetEndcapLayerTilesConstants.h"
 #include "CLICdetBarrelLayerTilesConstants.h"
@@ -51,11 +52,7 @@ class LayerTiles_T {
     }
 
     void fill(float x, float y, float phi, int i) {
-      if(T::endcap){
-        layerTiles_[getGlobalBin(x,y)].push_back(i);
-      } else { 
-        layerTiles_[getGlobalBinPhi(phi,y)].push_back(i);
-      }
+      layerTiles_[clue::geometry_t<T>::globalBin(*this, x, y, phi)].push_back(i);
     }
 
     int getXBin(float x) const {
@@ -80,6 +77,8 @@ class LayerTiles_T {
       auto normPhi = reco::normalizedPhi(phi);
       constexpr float r = T::nColumnsPhi * M_1_PI * 0.5f;
       int phiBin = (normPhi + M_PI) * r;
+      // phi = +pi would fall just after the last column
+      phiBin = std::min(phiBin,T::nColumnsPhi-1);
       return phiBin;
     }
 
@@ -110,9 +109,9 @@ class LayerTiles_T {
     /**
      * If the search window cross the phi-bin boundary, add T::nPhiBins to the
      * max value. This guarantees that the caller can perform a valid double
-     * loop on eta and phi. It is the caller responsibility to perform a modulo
-     * operation on the phiBin values returned by this function, to explore the
-     * correct bins.
+     * loop on eta and phi. The window spans less than T::nColumnsPhi bins, so
+     * it is the caller responsibility to subtract T::nColumnsPhi from the
+     * phiBin values beyond the last column, to explore the correct bins.
      */
     std::array<int, 4> searchBoxPhiZ(float phiMin, float phiMax, float zMin, float zMax) const {
       int phiBinMin = getPhiBin(phiMin);
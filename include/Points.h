@@ -19,33 +19,65 @@
 #ifndef Points_h
 #define Points_h
 
+#include <memory_resource>
+#include <span>
+#include <vector>
+
 struct Points {
+
+  // all the columns allocate from mr, see CLUEAlgo_T::setMemoryResource
+  explicit Points(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+    : xCopy(mr), yCopy(mr), rCopy(mr), layerCopy(mr), weightCopy(mr), timeCopy(mr), phi(mr), invR(mr),
+      rho(mr), delta(mr), nearestHigher(mr), clusterIndex(mr), followers(mr), isSeed(mr) {}
+
+  // inputs, read in place from the arrays given to CLUEAlgo_T::clearAndSetPoints
+  std::span<const float> x;
+  std::span<const float> y;
+  std::span<const float> r;
+  std::span<const int> layer;
+  std::span<const float> weight;
+  // only set if CLUEAlgo_T::timeWindow_ is set
+  std::span<const float> time;
+  // storage of the inputs which are not the caller's arrays: the points kept by the
+  // energy prefilter, and r = 0 when none is given (endcaps)
+  std::pmr::vector<float> xCopy;
+  std::pmr::vector<float> yCopy;
+  std::pmr::vector<float> rCopy;
+  std::pmr::vector<int> layerCopy;
+  std::pmr::vector<float> weightCopy;
+  std::pmr::vector<float> timeCopy;
+  // barrel only, filled from x and r: phi = x / r and 1/r
+  std::pmr::vector<float> phi;
+  std::pmr::vector<float> invR;
   
-  std::vector<float> x;
-  std::vector<float> y;
-  std::vector<float> r;
-  std::vector<int> layer;
-  std::vector<float> weight;
-  
-  std::vector<float> rho;
-  std::vector<float> delta;
-  std::vector<int> nearestHigher;
-  std::vector<int> clusterIndex;
-  std::vector<std::vector<int>> followers;
-  std::vector<int> isSeed;
+  std::pmr::vector<float> rho;
+  std::pmr::vector<float> delta;
+  std::pmr::vector<int> nearestHigher;
+  std::pmr::vector<int> clusterIndex;
+  std::pmr::vector<std::pmr::vector<int>> followers;
+  std::pmr::vector<int> isSeed;
   // why use int instead of bool?
   // https://en.cppreference.com/w/cpp/container/vector_bool
   // std::vector<bool> behaves similarly to std::vector, but in order to be space efficient, it:
   // Does not necessarily store its elements as a contiguous array (so &v[0] + n != &v[n])
 
-  size_t n;
+  size_t n = 0;
 
   void clear() {
-    x.clear();
-    y.clear();
-    r.clear();
-    layer.clear();
-    weight.clear();
+    x = {};
+    y = {};
+    r = {};
+    layer = {};
+    weight = {};
+    time = {};
+    xCopy.clear();
+    yCopy.clear();
+    rCopy.clear();
+    layerCopy.clear();
+    weightCopy.clear();
+    timeCopy.clear();
+    phi.clear();
+    invR.clear();
 
     rho.clear();
     delta.clear();
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TimingStats_h
+#define TimingStats_h
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clue {
+
+  // Removes from v the values more than 3 sigma away from its mean
+  void exclude_stats_outliers(std::vector<float>& v);
+  // Mean and standard deviation of v
+  std::pair<float, float> stats(const std::vector<float>& v);
+  // Prints the mean and sigma of vals after one and two rounds of outlier removal
+  void printTimingReport(std::vector<float>& vals, int repeats, const std::string& label);
+
+} // namespace clue
+
+#endif // TimingStats_h
@@ -48,6 +48,14 @@ namespace reco {
     return reduceRange(phi1 - phi2);
   }
 
+  // deltaPhi without branches, for two angles less than 3pi apart (e.g. both
+  // within [-pi,pi] up to rounding), which it then gives to the last bit
+  template <typename T>
+  constexpr T deltaPhiNormalized(T phi1, T phi2) {
+    const T dphi = phi1 - phi2;
+    return dphi - T(2. * M_PI) * (int(dphi > T(M_PI)) - int(dphi < T(-M_PI)));
+  }
+
 };  // namespace reco
 
 #endif
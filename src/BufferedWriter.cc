@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "BufferedWriter.h"
+
+namespace clue {
+
+  BufferedWriter::BufferedWriter(std::FILE* file)
+      : file_(file), owned_(false), buffer_(std::make_unique<char[]>(bufferSize)) {}
+
+  BufferedWriter::BufferedWriter(const std::string& fileName, bool binary)
+      : file_(std::fopen(fileName.c_str(), binary ? "wb" : "w")),
+        owned_(true),
+        buffer_(std::make_unique<char[]>(bufferSize)) {}
+
+  BufferedWriter::~BufferedWriter() {
+    flush();
+    if (owned_ && file_ != nullptr)
+      std::fclose(file_);
+    else if (file_ != nullptr)
+      std::fflush(file_);
+  }
+
+  void BufferedWriter::flush() {
+    writeThrough(buffer_.get(), used_);
+    used_ = 0;
+  }
+
+  void BufferedWriter::writeThrough(const void* data, std::size_t bytes) {
+    if (bytes == 0 || file_ == nullptr)
+      return;
+    if (std::fwrite(data, 1, bytes, file_) != bytes)
+      failed_ = true;
+  }
+
+} // namespace clue
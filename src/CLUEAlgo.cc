@@ -17,229 +17,874 @@
  * limitations under the License.
  */
 #include "CLUEAlgo.h"
+#include "BufferedWriter.h"
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <chrono>
+#include <numeric>
+#include <tuple>
 
-template <typename TILES>
-void CLUEAlgo_T<TILES>::makeClusters(){
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::makeClusters(){
   if( dc_ == 0.0 && rhoc_ == 0.0 && outlierDeltaFactor_ == 0.0){
     std::cerr << "Input variables for CLUE are not set." << std::endl;
     return;
   }
 
+  clue::TraceScope trace("makeClusters", "CLUEAlgo", traceRegion_);
   auto startTOT = std::chrono::high_resolution_clock::now();
+  if constexpr (COUNTERS)
+    counters_.clear();
 
   // start clustering
   auto start = std::chrono::high_resolution_clock::now();
   prepareDataStructures();
   auto finish = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> elapsed = finish - start;
+  timings_.prepareDataStructures = elapsed.count() * 1000;
   if(verbose_)
     std::cout << "ClueGaudiAlgorithmWrapper: prepareDataStructures:     " << elapsed.count() *1000 << " ms" << std::endl;
 
+  // the time of filling the neighbour table is counted in calculateLocalDensity
   start = std::chrono::high_resolution_clock::now();
-  calculateLocalDensity();
+  usedNeighbourCache_ = neighbourCacheBytes_ > 0
+    && fillNeighbourTable(dc_, neighbourCacheBytes_ / (sizeof(int) + sizeof(float)));
+  if(usedNeighbourCache_)
+    calculateLocalDensityFromTable();
+  else
+    calculateLocalDensity();
   finish = std::chrono::high_resolution_clock::now();
   elapsed = finish - start;
+  timings_.calculateLocalDensity = elapsed.count() * 1000;
   if(verbose_)
     std::cout << "ClueGaudiAlgorithmWrapper: calculateLocalDensity:     " << elapsed.count() *1000 << " ms" << std::endl;
 
   start = std::chrono::high_resolution_clock::now();
-  calculateDistanceToHigher();
+  if(usedNeighbourCache_)
+    calculateDistanceToHigherFromTable();
+  else if(deltaEngine_ == CLUEDeltaEngine::DensitySorted)
+    calculateDistanceToHigherSorted();
+  else
+    calculateDistanceToHigher();
   finish = std::chrono::high_resolution_clock::now();
   elapsed = finish - start;
+  timings_.calculateDistanceToHigher = elapsed.count() * 1000;
   if(verbose_)
     std::cout << "ClueGaudiAlgorithmWrapper: calculateDistanceToHigher: " << elapsed.count() *1000 << " ms" << std::endl;
 
   findAndAssignClusters();  
+  restoreFilteredPoints();
 
   auto finishTOT = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> elapsedTOT = finishTOT - startTOT;
+  timings_.total = elapsedTOT.count() * 1000;
   if(verbose_)
     std::cout << "ClueGaudiAlgorithmWrapper: TOT: " << elapsedTOT.count() *1000 << " ms" << std::endl;
 }
 
-template <typename TILES>
-std::map<int, std::vector<int> > CLUEAlgo_T<TILES>::getClusters(){
+template <typename TILES, bool COUNTERS>
+CLUEClusterMap CLUEAlgo_T<TILES, COUNTERS>::getClusters(){
   // cluster all points with same clusterId
-  std::map<int, std::vector<int> > clusters; 
+  CLUEClusterMap clusters(resource_);
   for(unsigned i = 0; i < points_.n; i++) {
     clusters[points_.clusterIndex[i]].push_back(i);
   }
   return clusters;
 }
 
-template <typename TILES>
-void CLUEAlgo_T<TILES>::prepareDataStructures(){
+template <typename TILES, bool COUNTERS>
+std::vector<CLUEScanResult> CLUEAlgo_T<TILES, COUNTERS>::scanClusters(const std::vector<std::pair<float, float>>& settings){
+  std::vector<CLUEScanResult> results;
+  if(settings.empty() || points_.n + droppedPoints_.size() == 0)
+    return results;
+
+  clue::TraceScope trace("scanClusters", "CLUEAlgo", traceRegion_);
+  auto startTOT = std::chrono::high_resolution_clock::now();
+  if constexpr (COUNTERS)
+    counters_.clear();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  prepareDataStructures();
+  std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+  timings_.prepareDataStructures = elapsed.count() * 1000;
+
+  start = std::chrono::high_resolution_clock::now();
+  calculateLocalDensity();
+  elapsed = std::chrono::high_resolution_clock::now() - start;
+  timings_.calculateLocalDensity = elapsed.count() * 1000;
+
+  // the nearest highers of every setting are found at the largest distance, without
+  // the seed delta cap, which only holds for rhoc_: with a larger rhoc of a setting,
+  // a point above rhoc_ may be a follower and needs its nearest higher past dc
+  start = std::chrono::high_resolution_clock::now();
+  const float outlierDeltaFactor = outlierDeltaFactor_;
+  const bool capSeedDelta = capSeedDelta_;
+  outlierDeltaFactor_ = std::max_element(settings.begin(), settings.end(),
+                                         [](const auto& a, const auto& b) { return a.second < b.second; })->second;
+  capSeedDelta_ = false;
+  calculateDistanceToHigher();
+  outlierDeltaFactor_ = outlierDeltaFactor;
+  capSeedDelta_ = capSeedDelta;
+  elapsed = std::chrono::high_resolution_clock::now() - start;
+  timings_.calculateDistanceToHigher = elapsed.count() * 1000;
+
+  start = std::chrono::high_resolution_clock::now();
+  std::pmr::vector<int> byRho(resource_);
+  sortByDecreasingRho(byRho);
+  results.reserve(settings.size());
+  for(const auto& [rhoc, odf] : settings) {
+    auto& res = results.emplace_back();
+    res.dc = dc_;
+    res.rhoc = rhoc;
+    res.outlierDeltaFactor = odf;
+    assignScanClusters(byRho, res);
+  }
+  elapsed = std::chrono::high_resolution_clock::now() - start;
+  timings_.findSeedAndFollowers = elapsed.count() * 1000;
+  timings_.assignClusters = 0.;
+  for(auto& res : results)
+    restoreFilteredResult(res);
+  restoreFilteredPoints();
+
+  elapsed = std::chrono::high_resolution_clock::now() - startTOT;
+  timings_.total = elapsed.count() * 1000;
+  return results;
+}
+
+template <typename TILES, bool COUNTERS>
+std::vector<CLUEScanResult> CLUEAlgo_T<TILES, COUNTERS>::scanCriticalDistances(std::vector<float> dcs){
+  std::vector<CLUEScanResult> results;
+  if(dcs.empty() || points_.n + droppedPoints_.size() == 0)
+    return results;
+  std::sort(dcs.begin(), dcs.end());
+  const int nDc = dcs.size();
+
+  clue::TraceScope trace("scanCriticalDistances", "CLUEAlgo", traceRegion_);
+  auto startTOT = std::chrono::high_resolution_clock::now();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  prepareDataStructures();
+  std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+  timings_.prepareDataStructures = elapsed.count() * 1000;
+
+  // the neighbours within the density or the nearest-higher distance of the
+  // largest dc, found in the order of makeClusters() for every smaller dc
+  start = std::chrono::high_resolution_clock::now();
+  fillNeighbourTable(dcs.back(), std::numeric_limits<std::size_t>::max());
+
+  // rho of every dc: a neighbour counts for the dcs from the first one which
+  // contains it, so each rho is summed in the order of calculateLocalDensity
+  std::pmr::vector<float> dc2(nDc, resource_);
+  for(int k = 0; k < nDc; k++)
+    dc2[k] = dcs[k] * dcs[k];
+  std::pmr::vector<float> rhos(static_cast<std::size_t>(points_.n) * nDc, 0.f, resource_);
+  for(unsigned idx = 0; idx < points_.n; idx++) {
+    const int i = layerPoints_[idx];
+    float* rho_i = &rhos[static_cast<std::size_t>(i) * nDc];
+    for(int n = neighbourOffsets_[idx]; n < neighbourOffsets_[idx + 1]; n++) {
+      const int j = neighbours_[n];
+      const float w = (i == j ? 1.f : 0.5f) * points_.weight[j];
+      for(int k = std::lower_bound(dc2.begin(), dc2.end(), neighbourDistance2_[n]) - dc2.begin(); k < nDc; k++)
+        rho_i[k] += w;
+    }
+  }
+  elapsed = std::chrono::high_resolution_clock::now() - start;
+  timings_.calculateLocalDensity = elapsed.count() * 1000;
+  timings_.calculateDistanceToHigher = 0.;
+  timings_.findSeedAndFollowers = 0.;
+
+  std::pmr::vector<int> byRho(resource_);
+  results.reserve(nDc);
+  for(int k = 0; k < nDc; k++) {
+    start = std::chrono::high_resolution_clock::now();
+    for(unsigned i = 0; i < points_.n; i++)
+      points_.rho[i] = rhos[static_cast<std::size_t>(i) * nDc + k];
+
+    // nearest higher within the outlier distance of this dc
+    const float dm = outlierDeltaFactor_ * dcs[k];
+    for(unsigned idx = 0; idx < points_.n; idx++) {
+      const int i = layerPoints_[idx];
+      const float rho_i = points_.rho[i];
+      float delta_i = std::numeric_limits<float>::max();
+      int nearestHigher_i = -1;
+      for(int n = neighbourOffsets_[idx]; n < neighbourOffsets_[idx + 1]; n++) {
+        const int j = neighbours_[n];
+        const bool foundHigher = (points_.rho[j] > rho_i) || ((points_.rho[j] == rho_i) && (j > i));
+        const float dist_ij = std::sqrt(neighbourDistance2_[n]);
+        if(foundHigher && dist_ij <= dm && dist_ij < delta_i) {
+          delta_i = dist_ij;
+          nearestHigher_i = j;
+        }
+      }
+      points_.delta[i] = delta_i;
+      points_.nearestHigher[i] = nearestHigher_i;
+    }
+    elapsed = std::chrono::high_resolution_clock::now() - start;
+    timings_.calculateDistanceToHigher += elapsed.count() * 1000;
+
+    start = std::chrono::high_resolution_clock::now();
+    auto& res = results.emplace_back();
+    res.dc = dcs[k];
+    res.rhoc = rhoc_;
+    res.outlierDeltaFactor = outlierDeltaFactor_;
+    sortByDecreasingRho(byRho);
+    assignScanClusters(byRho, res);
+    elapsed = std::chrono::high_resolution_clock::now() - start;
+    timings_.findSeedAndFollowers += elapsed.count() * 1000;
+  }
+  timings_.assignClusters = 0.;
+  for(auto& res : results)
+    restoreFilteredResult(res);
+  restoreFilteredPoints();
+
+  elapsed = std::chrono::high_resolution_clock::now() - startTOT;
+  timings_.total = elapsed.count() * 1000;
+  return results;
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::filterPoints(int n, const float* weight){
+  keptPoints_.clear();
+  droppedPoints_.clear();
+  if(energyThreshold_ <= 0.f)
+    return;
+
+  // branchless compaction: every index is written at the end of both lists
+  // and only the end of the list it belongs to moves on
+  keptPoints_.resize(n);
+  droppedPoints_.resize(n);
+  int nKept = 0;
+  int nDropped = 0;
+  for(int i = 0; i < n; i++) {
+    const int keep = weight[i] >= energyThreshold_;
+    keptPoints_[nKept] = i;
+    droppedPoints_[nDropped] = i;
+    nKept += keep;
+    nDropped += 1 - keep;
+  }
+  keptPoints_.resize(nKept);
+  droppedPoints_.resize(nDropped);
+  // nothing to drop, the points are taken as they are
+  if(nDropped == 0)
+    keptPoints_.clear();
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::setInputs(Points& p, const InputArrays& in) const {
+  const std::size_t n = in.n;
+  p.x = {in.x, n};
+  p.y = {in.y, n};
+  p.layer = {in.layer, n};
+  p.weight = {in.weight, n};
+  // If the layer tile is declared as endcap, the r info is not used
+  if(in.r != NULL) {
+    p.r = {in.r, n};
+  } else {
+    p.rCopy.assign(n, 0.f);
+    p.r = p.rCopy;
+  }
+  if(timeWindow_ > 0.f)
+    p.time = {in.time, n};
+  p.n = n;
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::copyInputs(Points& p, const std::pmr::vector<int>& indices,
+                                             const InputArrays& in) const {
+  const std::size_t m = indices.size();
+  p.xCopy.resize(m);
+  p.yCopy.resize(m);
+  p.layerCopy.resize(m);
+  p.weightCopy.resize(m);
+  p.rCopy.resize(m);
+  for(std::size_t k = 0; k < m; k++) {
+    const int i = indices[k];
+    p.xCopy[k] = in.x[i];
+    p.yCopy[k] = in.y[i];
+    p.layerCopy[k] = in.layer[i];
+    p.weightCopy[k] = in.weight[i];
+    // If the layer tile is declared as endcap, the r info is not used
+    p.rCopy[k] = in.r != NULL ? in.r[i] : 0.f;
+  }
+  p.x = p.xCopy;
+  p.y = p.yCopy;
+  p.layer = p.layerCopy;
+  p.weight = p.weightCopy;
+  p.r = p.rCopy;
+  if(timeWindow_ > 0.f) {
+    p.timeCopy.resize(m);
+    for(std::size_t k = 0; k < m; k++)
+      p.timeCopy[k] = in.time[indices[k]];
+    p.time = p.timeCopy;
+  }
+  p.n = m;
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::restoreFilteredPoints(){
+  if(droppedPoints_.empty())
+    return;
+
+  // the results of the clustered points are scattered in place to their input index,
+  // from the last one: keptPoints_ is increasing, so keptPoints_[k] >= k and no result
+  // is overwritten before it is moved (the columns were reserved for all the points)
+  const std::size_t n = keptPoints_.size() + droppedPoints_.size();
+  points_.rho.resize(n);
+  points_.delta.resize(n);
+  points_.nearestHigher.resize(n);
+  points_.followers.resize(n);
+  points_.clusterIndex.resize(n);
+  points_.isSeed.resize(n);
+  for(int k = int(keptPoints_.size()) - 1; k >= 0; k--) {
+    const int i = keptPoints_[k];
+    const int nh = points_.nearestHigher[k];
+    points_.nearestHigher[i] = nh >= 0 ? keptPoints_[nh] : -1;
+    for(int& j : points_.followers[k])
+      j = keptPoints_[j];
+    if(i == k)
+      continue;
+    points_.rho[i] = points_.rho[k];
+    points_.delta[i] = points_.delta[k];
+    points_.followers[i] = std::move(points_.followers[k]);
+    points_.clusterIndex[i] = points_.clusterIndex[k];
+    points_.isSeed[i] = points_.isSeed[k];
+  }
+  // the points below the threshold are outliers
+  for(int i : droppedPoints_) {
+    points_.rho[i] = 0.f;
+    points_.delta[i] = std::numeric_limits<float>::max();
+    points_.nearestHigher[i] = -1;
+    points_.followers[i].clear();
+    points_.clusterIndex[i] = -1;
+    points_.isSeed[i] = 0;
+  }
+  // and the inputs are the caller's arrays again
+  setInputs(points_, inputs_);
+  geometry_type::preparePoints(points_);
+  keptPoints_.clear();
+  droppedPoints_.clear();
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::restoreFilteredResult(CLUEScanResult& res) const {
+  if(droppedPoints_.empty())
+    return;
+
+  const std::size_t n = keptPoints_.size() + droppedPoints_.size();
+  std::vector<int> isSeed(n, 0);
+  std::vector<int> clusterIndex(n, -1);
+  for(std::size_t k = 0; k < keptPoints_.size(); k++) {
+    isSeed[keptPoints_[k]] = res.isSeed[k];
+    clusterIndex[keptPoints_[k]] = res.clusterIndex[k];
+  }
+  res.isSeed = std::move(isSeed);
+  res.clusterIndex = std::move(clusterIndex);
+  res.nOutliers += droppedPoints_.size();
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::sortTilesByTime(int layer){
+  if(layerOffsets_[layer] == layerOffsets_[layer + 1])
+    return;
+  auto& lt = allLayerTiles_[layer];
+  for(int binId = 0; binId < TILES::constants_type_t::nTiles; binId++) {
+    auto& bin = lt[binId];
+    // the index keeps the order of the points with the same time
+    std::sort(bin.begin(), bin.end(), [&](int i, int j) {
+      return points_.time[i] < points_.time[j] || (points_.time[i] == points_.time[j] && i < j);
+    });
+  }
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::sortByDecreasingRho(std::pmr::vector<int>& byRho) const {
+  // ties are broken by the index as in calculateDistanceToHigher,
+  // so that every nearest higher comes before its followers
+  byRho.resize(points_.n);
+  std::iota(byRho.begin(), byRho.end(), 0);
+  std::sort(byRho.begin(), byRho.end(), [&](int i, int j) {
+    return points_.rho[i] > points_.rho[j] || (points_.rho[i] == points_.rho[j] && i > j);
+  });
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::assignScanClusters(const std::pmr::vector<int>& byRho, CLUEScanResult& res) const {
+  res.isSeed.assign(points_.n, 0);
+  res.clusterIndex.assign(points_.n, -1);
+
+  // delta is the one of makeClusters() only if it is within dm,
+  // otherwise there is no nearest higher for this setting
+  const float dm = res.outlierDeltaFactor * res.dc;
+  auto delta = [&](int i) { return points_.delta[i] <= dm ? points_.delta[i] : std::numeric_limits<float>::max(); };
+
+  // seeds are numbered per layer in the order of findAndAssignClusters()
+  for(int l = 0; l < TILES::constants_type_t::nLayers; l++) {
+    int nClusters = 0;
+    for(int idx = layerOffsets_[l]; idx < layerOffsets_[l + 1]; idx++) {
+      const int i = layerPoints_[idx];
+      if((delta(i) > res.dc) and (points_.rho[i] >= res.rhoc)) {
+        res.isSeed[i] = 1;
+        res.clusterIndex[i] = nClusters++;
+      }
+    }
+    res.nSeeds += nClusters;
+  }
+
+  // followers take the cluster of their nearest higher, outliers keep -1
+  for(int i : byRho) {
+    if(res.isSeed[i])
+      continue;
+    const bool isOutlier = (delta(i) > dm) and (points_.rho[i] < res.rhoc);
+    if(!isOutlier)
+      res.clusterIndex[i] = res.clusterIndex[points_.nearestHigher[i]];
+    res.nOutliers += (res.clusterIndex[i] == -1);
+  }
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::verboseResults(std::string outputFileName, int nVerbose) const {
+  if(!verbose_)
+    return;
+  if(nVerbose == -1 || nVerbose > int(points_.n))
+    nVerbose = points_.n;
+
+  const bool toScreen = outputFileName.compare("cout") == 0;
+  if(toScreen)
+    std::cout.flush();
+  clue::BufferedWriter out = toScreen ? clue::BufferedWriter(stdout) : clue::BufferedWriter(outputFileName);
+  if(!out.good()){
+    std::cerr << "ERROR: Failed to open the file " << outputFileName << std::endl;
+    return;
+  }
+
+  out << "index,x,y,layer,weight,rho,delta,nh,isSeed,clusterId\n";
+  for(int i = 0; i < nVerbose; i++) {
+    out << i << ',' << points_.x[i] << ',' << points_.y[i] << ',' << points_.layer[i] << ','
+        << points_.weight[i] << ',' << points_.rho[i] << ',';
+    if(points_.delta[i] <= 999)
+      out << points_.delta[i];
+    else
+      out << "999"; //convert +inf to 999 in verbose
+    out << ',' << points_.nearestHigher[i] << ',' << points_.isSeed[i] << ',' << points_.clusterIndex[i] << '\n';
+  }
+  if(toScreen)
+    out << '\n';
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::verboseResultsBinary(const std::string& outputFileName, int nVerbose) const {
+  if(!verbose_)
+    return;
+  if(nVerbose == -1 || nVerbose > int(points_.n))
+    nVerbose = points_.n;
+
+  clue::BufferedWriter out(outputFileName, true);
+  if(!out.good()){
+    std::cerr << "ERROR: Failed to open the file " << outputFileName << std::endl;
+    return;
+  }
+
+  const char magic[8] = {'C', 'L', 'U', 'E', 'V', 'R', 'B', '\0'};
+  const std::uint32_t version = 1;
+  const std::uint64_t n = nVerbose;
+  out.write(magic, sizeof(magic));
+  out.write(&version, sizeof(version));
+  out.write(&n, sizeof(n));
+  auto column = [&](const auto& v) { out.write(v.data(), n * sizeof(v[0])); };
+  column(points_.x);
+  column(points_.y);
+  column(points_.layer);
+  column(points_.weight);
+  column(points_.rho);
+  column(points_.delta);
+  column(points_.nearestHigher);
+  column(points_.isSeed);
+  column(points_.clusterIndex);
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::groupPointsByLayer(){
+  // group the point indices by layer, keeping their order within a layer
+  constexpr int nLayers = TILES::constants_type_t::nLayers;
+  layerOffsets_.assign(nLayers + 1, 0);
+  for (size_t i=0; i<points_.n; i++){
+    layerOffsets_[points_.layer[i] + 1]++;
+  }
+  for (int l = 0; l < nLayers; l++){
+    layerOffsets_[l + 1] += layerOffsets_[l];
+  }
+  layerPoints_.resize(points_.n);
+  std::pmr::vector<int> next(layerOffsets_.begin(), layerOffsets_.end() - 1, resource_);
   for (size_t i=0; i<points_.n; i++){
-    // push index of points into tiles
-    allLayerTiles_.fill( points_.layer[i], points_.x[i], points_.y[i], points_.x[i]/(1.*points_.r[i]), i );
+    layerPoints_[next[points_.layer[i]]++] = i;
   }
 }
 
-template <typename TILES>
-void CLUEAlgo_T<TILES>::calculateLocalDensity(){
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::prepareDataStructures(){
+  clue::TraceScope trace("prepareDataStructures", "CLUEAlgo", traceRegion_);
+
+  groupPointsByLayer();
+  flatTiles_ = false;
+  // push index of points into tiles
+  for (size_t i=0; i<points_.n; i++){
+    auto& lt = allLayerTiles_[points_.layer[i]];
+    lt[geometry_type::globalBin(lt, points_, i)].push_back(i);
+  }
+  if (timeWindow_ > 0.f){
+    for (int l = 0; l < TILES::constants_type_t::nLayers; l++){
+      sortTilesByTime(l);
+    }
+  }
+
+  if constexpr (COUNTERS) {
+    counters_.maxTileOccupancy.assign(TILES::constants_type_t::nLayers, 0);
+    counters_.meanTileOccupancy.assign(TILES::constants_type_t::nLayers, 0.f);
+    for (int l = 0; l < TILES::constants_type_t::nLayers; l++) {
+      const auto& lt = allLayerTiles_[l];
+      unsigned nFilled = 0;
+      unsigned nPoints = 0;
+      for (int binId = 0; binId < TILES::constants_type_t::nTiles; binId++) {
+        unsigned binSize = lt[binId].size();
+        nFilled += (binSize > 0);
+        nPoints += binSize;
+        counters_.maxTileOccupancy[l] = std::max(counters_.maxTileOccupancy[l], binSize);
+      }
+      if (nFilled > 0)
+        counters_.meanTileOccupancy[l] = float(nPoints) / nFilled;
+    }
+  }
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::calculateLocalDensity(){
 //  std::cout << "calculateLocalDensity for " << points_.n << " points." << std::endl;
   std::array<int,4> search_box = {0, 0, 0, 0};
   auto dc2 = dc_*dc_;
 
-  // loop over all points
-  for(size_t i = 0; i < points_.n; i++) {
-    const auto& lt = allLayerTiles_[points_.layer[i]];
-    float ri = points_.r[i];
-    float inv_ri = 1.f/ri;
-    float phi_i = points_.x[i]*inv_ri;
-
-    // get search box
-    search_box = lt.searchBox(points_.x[i]-dc_, points_.x[i]+dc_, points_.y[i]-dc_, points_.y[i]+dc_);
-
-    if(!TILES::constants_type_t::endcap){
-      float dc_phi = dc_*inv_ri;
-      search_box = lt.searchBoxPhiZ(phi_i-dc_phi, phi_i+dc_phi, points_.y[i]-dc_, points_.y[i]+dc_);
-    }
-
-//    std::cout << "searchbox xBins: " << search_box[0] << "," << search_box[1] << std::endl;
-//    std::cout << "          yBins: " << search_box[2] << "," << search_box[3] << std::endl;
-    // loop over bins in the search box
-    for(int xBin = search_box[0]; xBin <= search_box[1]; ++xBin) {
-      for(int yBin = search_box[2]; yBin <= search_box[3]; ++yBin) {
+  // loop over all points, layer by layer
+  for(int l = 0; l < TILES::constants_type_t::nLayers; l++) {
+    if(layerOffsets_[l] == layerOffsets_[l + 1])
+      continue;
+    clue::TraceScope trace("calculateLocalDensity", "CLUEAlgo", traceRegion_, l);
+    const auto& lt = allLayerTiles_[l];
+    for(int idx = layerOffsets_[l]; idx < layerOffsets_[l + 1]; idx++) {
+      const unsigned i = layerPoints_[idx];
+
+      // get search box
+      search_box = geometry_type::searchBox(lt, points_, i, dc_);
+
+  //    std::cout << "searchbox xBins: " << search_box[0] << "," << search_box[1] << std::endl;
+  //    std::cout << "          yBins: " << search_box[2] << "," << search_box[3] << std::endl;
+      // loop over bins in the search box
+      for(int xBin = search_box[0]; xBin <= search_box[1]; ++xBin) {
+        for(int yBin = search_box[2]; yBin <= search_box[3]; ++yBin) {
   
-        // get the id of this bin
-        int binId = lt.getGlobalBinByBin(xBin,yBin);
-        if(!TILES::constants_type_t::endcap){
-          int phi = (xBin % TILES::constants_type_t::nColumnsPhi);
-          binId = lt.getGlobalBinByBinPhi(phi, yBin);
-        }
-        // get the size of this bin
-        size_t binSize = lt[binId].size();
-//        std::cout << "binSize = " << binSize << " for [xBin,yBin] = [" << xBin << "," << yBin << "]" << std::endl;
-
-        // iterate inside this bin
-        for (size_t binIter = 0; binIter < binSize; binIter++) {
-          auto j = lt[binId][binIter];
-          // query N_{dc_}(i)
-          float dist2_ij = TILES::constants_type_t::endcap ?
-           distance2(i, j) : distance2(i, j, true, ri);
-          if(dist2_ij <= dc2) {
-            // sum weights within N_{dc_}(i)
-            points_.rho[i] += (i == static_cast<unsigned int>(j) ? 1.f : 0.5f) * points_.weight[j];
+          // get the id of this bin
+          int binId = geometry_type::binId(lt, xBin, yBin);
+          // get the size of this bin
+          const auto candidates = binCandidates(lt[binId], i);
+          size_t binSize = candidates.size();
+  //        std::cout << "binSize = " << binSize << " for [xBin,yBin] = [" << xBin << "," << yBin << "]" << std::endl;
+          if constexpr (COUNTERS) {
+            counters_.localDensity.binsVisited++;
+            counters_.localDensity.emptyBinsVisited += (binSize == 0);
+            counters_.localDensity.distancesEvaluated += binSize;
           }
-        } // end of interate inside this bin
-      } 
-    } // end of loop over bins in search box
-  } // end of loop over points
+
+          // iterate inside this bin
+          for (size_t binIter = 0; binIter < binSize; binIter++) {
+            auto j = candidates[binIter];
+            // query N_{dc_}(i)
+            float dist2_ij = geometry_type::distance2(points_, i, j);
+            if(dist2_ij <= dc2) {
+              if constexpr (COUNTERS)
+                counters_.localDensity.acceptedNeighbours++;
+              // sum weights within N_{dc_}(i)
+              points_.rho[i] += (i == static_cast<unsigned int>(j) ? 1.f : 0.5f) * points_.weight[j];
+            }
+          } // end of interate inside this bin
+        } 
+      } // end of loop over bins in search box
+    } // end of loop over points
+  } // end of loop over layers
 
 }
 
 
-template <typename TILES>
-void CLUEAlgo_T<TILES>::calculateDistanceToHigher(){
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::calculateDistanceToHigher(){
   // loop over all points
-  float dm = outlierDeltaFactor_ * dc_;
-  for(size_t i = 0; i < points_.n; i++) {
-    // default values of delta and nearest higher for i
-    float delta_i = std::numeric_limits<float>::max();
-    int nearestHigher_i = -1;
-    float xi = points_.x[i];
-    float yi = points_.y[i];
-    float ri = points_.r[i];
-    float inv_ri = 1.f/ri;
-    float phi_i = points_.x[i]*inv_ri;
-    float rho_i = points_.rho[i];
-
-    //get search box
-    const auto& lt = allLayerTiles_[points_.layer[i]];
-    float dm_phi = dm*inv_ri;
-    std::array<int,4> search_box = TILES::constants_type_t::endcap ? 
-     lt.searchBox(xi-dm, xi+dm, yi-dm, yi+dm):
-     lt.searchBoxPhiZ(phi_i-dm_phi, phi_i+dm_phi, points_.y[i]-dm, points_.y[i]+dm);
-
-    // loop over all bins in the search box
-    for(int xBin = search_box[0]; xBin <= search_box[1]; ++xBin) {
-      for(int yBin = search_box[2]; yBin <= search_box[3]; ++yBin) {
-
-        // get the id of this bin
-        int phi = (xBin % TILES::constants_type_t::nColumnsPhi);
-        int binId = TILES::constants_type_t::endcap ?
-         lt.getGlobalBinByBin(xBin,yBin):
-         lt.getGlobalBinByBinPhi(phi, yBin);
-
-        // get the size of this bin
-        int binSize = lt[binId].size();
-
-        // interate inside this bin
-        for (int binIter = 0; binIter < binSize; binIter++) {
-          int j = lt[binId][binIter];
+  for(int l = 0; l < TILES::constants_type_t::nLayers; l++) {
+    if(layerOffsets_[l] == layerOffsets_[l + 1])
+      continue;
+    clue::TraceScope trace("calculateDistanceToHigher", "CLUEAlgo", traceRegion_, l);
+    for(int idx = layerOffsets_[l]; idx < layerOffsets_[l + 1]; idx++) {
+      const int i = layerPoints_[idx];
+      std::tie(points_.delta[i], points_.nearestHigher[i]) = searchNearestHigher(l, i);
+    } // end of loop over points
+  } // end of loop over layers
+
+}
+
+template <typename TILES, bool COUNTERS>
+std::pair<float, int> CLUEAlgo_T<TILES, COUNTERS>::searchNearestHigher(int l, int i){
+  return searchNearestHigherIn<false>(l, i);
+}
+
+template <typename TILES, bool COUNTERS>
+template <bool SORTED>
+std::pair<float, int> CLUEAlgo_T<TILES, COUNTERS>::searchNearestHigherIn(int l, int i){
+  // with SORTED, the tiles only hold the points of higher density, in the order they were inserted
+  const auto& lt = SORTED ? (*higherTiles_)[l] : allLayerTiles_[l];
+  const float rho_i = points_.rho[i];
+  const float dm = outlierDeltaFactor_ * dc_;
+  const float maxDelta = (capSeedDelta_ && rho_i >= rhoc_) ? std::min(dc_, dm) : dm;
+  // the full box, whose scan order decides between equal deltas
+  const std::array<int,4> box = geometry_type::searchBox(lt, points_, i, maxDelta);
+
+  // default values of delta and nearest higher for i
+  float delta_i = std::numeric_limits<float>::max();
+  int nearestHigher_i = -1;
+  int xBest = 0;
+  int yBest = 0;
+
+  // bins already searched, in the frame of box
+  std::array<int,4> searched = {0, -1, 0, -1};
+  for(float radius = std::min(dc_, maxDelta); ; radius = std::min(2.f * radius, maxDelta)) {
+    std::array<int,4> ring = box;
+    if(radius < maxDelta) {
+      ring = geometry_type::searchBox(lt, points_, i, radius);
+      // a phi window may start past the last column in box and not here, or conversely
+      int xFirst = ring[0];
+      if(xFirst < box[0] || ring[1] > box[1]) {
+        for(int xBin = box[0]; xBin <= box[1]; ++xBin) {
+          if(geometry_type::binId(lt, xBin, ring[2]) == geometry_type::binId(lt, ring[0], ring[2])) {
+            xFirst = xBin;
+            break;
+          }
+        }
+      }
+      ring = {std::max(xFirst, box[0]), std::min(xFirst + ring[1] - ring[0], box[1]),
+              std::max(ring[2], box[2]), std::min(ring[3], box[3])};
+    }
+
+    for(int xBin = ring[0]; xBin <= ring[1]; ++xBin) {
+      for(int yBin = ring[2]; yBin <= ring[3]; ++yBin) {
+        if(xBin >= searched[0] && xBin <= searched[1] && yBin >= searched[2] && yBin <= searched[3])
+          continue;
+
+        const int binId = geometry_type::binId(lt, xBin, yBin);
+        const auto candidates = SORTED ? std::span<const int>(lt[binId]) : binCandidates(tileBin(l, binId), i);
+        if constexpr (COUNTERS) {
+          counters_.distanceToHigher.binsVisited++;
+          counters_.distanceToHigher.emptyBinsVisited += candidates.empty();
+          counters_.distanceToHigher.distancesEvaluated += candidates.size();
+        }
+
+        for(int j : candidates) {
           // query N'_{dm}(i)
-          bool foundHigher = (points_.rho[j] > rho_i);
+          bool foundHigher = SORTED || (points_.rho[j] > rho_i);
           // in the rare case where rho is the same, use detid
-          foundHigher = foundHigher || ((points_.rho[j] == rho_i) && (static_cast<unsigned int>(j)>i) );
-          float dist_ij = TILES::constants_type_t::endcap ?
-           distance(i, j) : distance(i, j, true, ri);
-          if(foundHigher && dist_ij <= dm) { // definition of N'_{dm}(i)
-            // find the nearest point within N'_{dm}(i)
-            if (dist_ij < delta_i) {
-              // update delta_i and nearestHigher_i
+          foundHigher = foundHigher || ((points_.rho[j] == rho_i) && (j > i));
+          if constexpr (SORTED) {
+            // the time window of binCandidates, the bins are not sorted by time
+            if(timeWindow_ > 0.f && !(points_.time[j] > points_.time[i] - timeWindow_
+                                      && points_.time[j] < points_.time[i] + timeWindow_))
+              continue;
+          }
+          float dist_ij = std::sqrt(geometry_type::distance2(points_, i, j));
+          if(foundHigher && dist_ij <= maxDelta) { // definition of N'_{dm}(i)
+            if constexpr (COUNTERS)
+              counters_.distanceToHigher.acceptedNeighbours++;
+            // find the nearest point within N'_{dm}(i), the first one of the box order if several
+            if(dist_ij < delta_i
+               || (dist_ij == delta_i && (xBin < xBest || (xBin == xBest && (yBin < yBest
+                   || (SORTED && yBin == yBest && comesFirstInBin(j, nearestHigher_i))))))) {
               delta_i = dist_ij;
               nearestHigher_i = j;
+              xBest = xBin;
+              yBest = yBin;
             }
           }
-        } // end of interate inside this bin
+        }
       }
-    } // end of loop over bins in search box
+    }
+    searched = ring;
+
+    // the points outside the searched bins are farther than radius
+    if(delta_i <= radius || radius >= maxDelta)
+      break;
+  }
+
+  return {delta_i, nearestHigher_i};
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::calculateDistanceToHigherSorted(){
+  clue::TraceScope trace("calculateDistanceToHigherSorted", "CLUEAlgo", traceRegion_);
+  if(!higherTiles_)
+    higherTiles_ = std::make_unique<TILES>();
+
+  // every point only sees the points inserted before it, i.e. the ones of higher density
+  std::pmr::vector<int> byRho(resource_);
+  sortByDecreasingRho(byRho);
+  for(int i : byRho) {
+    const int l = points_.layer[i];
+    std::tie(points_.delta[i], points_.nearestHigher[i]) = searchNearestHigherIn<true>(l, i);
+    auto& lt = (*higherTiles_)[l];
+    lt[geometry_type::globalBin(lt, points_, i)].push_back(i);
+  }
+
+  // only the bins of the points have to be emptied
+  for(unsigned i = 0; i < points_.n; i++) {
+    auto& lt = (*higherTiles_)[points_.layer[i]];
+    lt[geometry_type::globalBin(lt, points_, i)].clear();
+  }
+}
 
+template <typename TILES, bool COUNTERS>
+bool CLUEAlgo_T<TILES, COUNTERS>::fillNeighbourTable(float dc, std::size_t maxPairs){
+  clue::TraceScope trace("fillNeighbourTable", "CLUEAlgo", traceRegion_);
+  const float dc2 = dc * dc;
+  const float dm = outlierDeltaFactor_ * dc;
+  neighbourOffsets_.assign(points_.n + 1, 0);
+  neighbours_.clear();
+  neighbourDistance2_.clear();
+  for(int l = 0; l < TILES::constants_type_t::nLayers; l++) {
+    const auto& lt = allLayerTiles_[l];
+    for(int idx = layerOffsets_[l]; idx < layerOffsets_[l + 1]; idx++) {
+      const int i = layerPoints_[idx];
+      const auto search_box = geometry_type::searchBox(lt, points_, i, std::max(dc, dm));
+      for(int xBin = search_box[0]; xBin <= search_box[1]; ++xBin) {
+        for(int yBin = search_box[2]; yBin <= search_box[3]; ++yBin) {
+          const auto candidates = binCandidates(lt[geometry_type::binId(lt, xBin, yBin)], i);
+          if constexpr (COUNTERS) {
+            counters_.localDensity.binsVisited++;
+            counters_.localDensity.emptyBinsVisited += candidates.empty();
+            counters_.localDensity.distancesEvaluated += candidates.size();
+          }
+          for(int j : candidates) {
+            const float dist2_ij = geometry_type::distance2(points_, i, j);
+            if(dist2_ij <= dc2 || std::sqrt(dist2_ij) <= dm) {
+              neighbours_.push_back(j);
+              neighbourDistance2_.push_back(dist2_ij);
+            }
+          }
+        }
+      }
+      if(neighbours_.size() > maxPairs)
+        return false;
+      neighbourOffsets_[idx + 1] = neighbours_.size();
+    }
+  }
+  return true;
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::calculateLocalDensityFromTable(){
+  clue::TraceScope trace("calculateLocalDensity", "CLUEAlgo", traceRegion_);
+  const float dc2 = dc_ * dc_;
+  for(unsigned idx = 0; idx < points_.n; idx++) {
+    const int i = layerPoints_[idx];
+    float rho_i = 0.f;
+    for(int n = neighbourOffsets_[idx]; n < neighbourOffsets_[idx + 1]; n++) {
+      if(neighbourDistance2_[n] <= dc2) {
+        if constexpr (COUNTERS)
+          counters_.localDensity.acceptedNeighbours++;
+        const int j = neighbours_[n];
+        rho_i += (i == j ? 1.f : 0.5f) * points_.weight[j];
+      }
+    }
+    points_.rho[i] = rho_i;
+  }
+}
+
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::calculateDistanceToHigherFromTable(){
+  clue::TraceScope trace("calculateDistanceToHigher", "CLUEAlgo", traceRegion_);
+  const float dm = outlierDeltaFactor_ * dc_;
+  for(unsigned idx = 0; idx < points_.n; idx++) {
+    const int i = layerPoints_[idx];
+    const float rho_i = points_.rho[i];
+    const float maxDelta = (capSeedDelta_ && rho_i >= rhoc_) ? std::min(dc_, dm) : dm;
+    float delta_i = std::numeric_limits<float>::max();
+    int nearestHigher_i = -1;
+    if constexpr (COUNTERS)
+      counters_.distanceToHigher.distancesEvaluated += neighbourOffsets_[idx + 1] - neighbourOffsets_[idx];
+    for(int n = neighbourOffsets_[idx]; n < neighbourOffsets_[idx + 1]; n++) {
+      const int j = neighbours_[n];
+      const bool foundHigher = (points_.rho[j] > rho_i) || ((points_.rho[j] == rho_i) && (j > i));
+      const float dist_ij = std::sqrt(neighbourDistance2_[n]);
+      if(foundHigher && dist_ij <= maxDelta) {
+        if constexpr (COUNTERS)
+          counters_.distanceToHigher.acceptedNeighbours++;
+        if(dist_ij < delta_i) {
+          delta_i = dist_ij;
+          nearestHigher_i = j;
+        }
+      }
+    }
     points_.delta[i] = delta_i;
     points_.nearestHigher[i] = nearestHigher_i;
-  } // end of loop over points
-
+  }
 }
 
-template <typename TILES>
-void CLUEAlgo_T<TILES>::findAndAssignClusters(){
+template <typename TILES, bool COUNTERS>
+void CLUEAlgo_T<TILES, COUNTERS>::findAndAssignClusters(){
 
   auto start = std::chrono::high_resolution_clock::now();
 
   std::array<int,TILES::constants_type_t::nLayers> nClustersPerLayer{};
 
   // find cluster seeds and outlier
-  std::vector<int> localStack;
+  std::pmr::vector<int> localStack(resource_);
   localStack.reserve(10);
-  // loop over all points
-  for(unsigned i = 0; i < points_.n; i++) {
-    // initialize clusterIndex
-    points_.clusterIndex[i] = -1;
-
-    float deltai = points_.delta[i];
-    float rhoi = points_.rho[i];
-
-    // determine seed or outlier 
-    bool isSeed = (deltai > dc_) and (rhoi >= rhoc_);
-    bool isOutlier = (deltai > outlierDeltaFactor_ * dc_) and (rhoi < rhoc_);
-    if (isSeed)
-      {
-	// set isSeed as 1
-	points_.isSeed[i] = 1;
-	// set cluster id
-	points_.clusterIndex[i] = nClustersPerLayer[points_.layer[i]];
-	// increment number of clusters
-        nClustersPerLayer[points_.layer[i]]++;
-	// add seed into local stack
-	localStack.push_back(i);
-      }
-    else if (!isOutlier)
-      {
-	// register as follower at its nearest higher
-	points_.followers[points_.nearestHigher[i]].push_back(i);   
-      }
-  }
+  // loop over all points, layer by layer
+  for(int l = 0; l < TILES::constants_type_t::nLayers; l++) {
+    if(layerOffsets_[l] == layerOffsets_[l + 1])
+      continue;
+    clue::TraceScope trace("findSeedAndFollowers", "CLUEAlgo", traceRegion_, l);
+    for(int idx = layerOffsets_[l]; idx < layerOffsets_[l + 1]; idx++) {
+      const unsigned i = layerPoints_[idx];
+      // initialize clusterIndex
+      points_.clusterIndex[i] = -1;
+
+      float deltai = points_.delta[i];
+      float rhoi = points_.rho[i];
+
+      // determine seed or outlier 
+      bool isSeed = (deltai > dc_) and (rhoi >= rhoc_);
+      bool isOutlier = (deltai > outlierDeltaFactor_ * dc_) and (rhoi < rhoc_);
+      if (isSeed)
+        {
+	  // set isSeed as 1
+	  points_.isSeed[i] = 1;
+	  // set cluster id
+	  points_.clusterIndex[i] = nClustersPerLayer[points_.layer[i]];
+	  // increment number of clusters
+          nClustersPerLayer[points_.layer[i]]++;
+	  // add seed into local stack
+	  localStack.push_back(i);
+        }
+      else if (!isOutlier)
+        {
+	  // register as follower at its nearest higher
+	  points_.followers[points_.nearestHigher[i]].push_back(i);   
+        }
+    } // end of loop over points
+  } // end of loop over layers
 
   auto finish = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> elapsed = finish - start;
+  timings_.findSeedAndFollowers = elapsed.count() * 1000;
   if(verbose_)
     std::cout << "ClueGaudiAlgorithmWrapper: findSeedAndFollowers:      " << elapsed.count() *1000 << " ms" << std::endl;
 
   start = std::chrono::high_resolution_clock::now();
+  clue::TraceScope trace("assignClusters", "CLUEAlgo", traceRegion_);
   // expend clusters from seeds
   while (!localStack.empty()) {
     int i = localStack.back();
@@ -256,45 +901,12 @@ void CLUEAlgo_T<TILES>::findAndAssignClusters(){
   }
   finish = std::chrono::high_resolution_clock::now();
   elapsed = finish - start;
+  timings_.assignClusters = elapsed.count() * 1000;
   if(verbose_)
     std::cout << "ClueGaudiAlgorithmWrapper: assignClusters:            " << elapsed.count() *1000 << " ms" << std::endl;
 
 }
 
-template <typename TILES>
-inline float CLUEAlgo_T<TILES>::distance2(int i, int j, bool isPhi, float r ) const {
-
-  // 2-d distance on the layer
-  if(points_.layer[i] == points_.layer[j] ) {
-    if (isPhi) {
-      const float phi_i = points_.x[i]/(points_.r[i]);
-      const float phi_j = points_.x[j]/(points_.r[j]);
-      const float drphi = r * reco::deltaPhi(phi_i, phi_j);
-      const float dy = points_.y[i] - points_.y[j];
-      return dy * dy + drphi * drphi;
-    } else {
-      const float dx = points_.x[i] - points_.x[j];
-      const float dy = points_.y[i] - points_.y[j];
-      return dx * dx + dy * dy;
-    }
-  } else {
-    return std::numeric_limits<float>::max();
-  }
-
-}
-
-template <typename TILES>
-inline float CLUEAlgo_T<TILES>::distance(int i, int j, bool isPhi, float r ) const {
-
-  // 2-d distance on the layer
-  if(points_.layer[i] == points_.layer[j] ) {
-    return std::sqrt(distance2(i, j, isPhi, r));
-  } else {
-    return std::numeric_limits<float>::max();
-  }
-
-}
-
 // explicit template instantiation
 template class CLUEAlgo_T<LayerTiles>;
 template class CLUEAlgo_T<CLICdetEndcapLayerTiles>;
@@ -302,3 +914,11 @@ template class CLUEAlgo_T<CLICdetBarrelLayerTiles>;
 template class CLUEAlgo_T<CLDEndcapLayerTiles>;
 template class CLUEAlgo_T<CLDBarrelLayerTiles>;
 template class CLUEAlgo_T<LArBarrelLayerTiles>;
+
+// with hot-path counters
+template class CLUEAlgo_T<LayerTiles, true>;
+template class CLUEAlgo_T<CLICdetEndcapLayerTiles, true>;
+template class CLUEAlgo_T<CLICdetBarrelLayerTiles, true>;
+template class CLUEAlgo_T<CLDEndcapLayerTiles, true>;
+template class CLUEAlgo_T<CLDBarrelLayerTiles, true>;
+template class CLUEAlgo_T<LArBarrelLayerTiles, true>;
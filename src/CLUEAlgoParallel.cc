@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CLUEAlgoParallel.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <tuple>
+
+template <typename TILES, typename BACKEND>
+void CLUEAlgoParallel_T<TILES, BACKEND>::makeClusters(){
+  if( this->dc_ == 0.0 && this->rhoc_ == 0.0 && this->outlierDeltaFactor_ == 0.0){
+    std::cerr << "Input variables for CLUE are not set." << std::endl;
+    return;
+  }
+
+  clue::TraceScope trace("makeClusters", BACKEND::name, this->traceRegion_);
+  auto startTOT = std::chrono::high_resolution_clock::now();
+
+  // run one phase and record its time
+  auto timed = [this](const char* label, double& timing, auto phase) {
+    auto start = std::chrono::high_resolution_clock::now();
+    (this->*phase)();
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    timing = elapsed.count() * 1000;
+    if(this->verbose_)
+      std::cout << "CLUEAlgoParallel (" << BACKEND::name << "): " << label << " " << timing << " ms" << std::endl;
+  };
+  timed("prepareDataStructures:    ", this->timings_.prepareDataStructures, &CLUEAlgoParallel_T::prepareDataStructures);
+  timed("calculateLocalDensity:    ", this->timings_.calculateLocalDensity, &CLUEAlgoParallel_T::calculateLocalDensity);
+  timed("calculateDistanceToHigher:", this->timings_.calculateDistanceToHigher, &CLUEAlgoParallel_T::calculateDistanceToHigher);
+  timed("findAndAssignClusters:    ", this->timings_.findSeedAndFollowers, &CLUEAlgoParallel_T::findAndAssignClusters);
+  // the seeds and the assignment are a single phase here
+  this->timings_.assignClusters = 0.;
+  this->restoreFilteredPoints();
+
+  std::chrono::duration<double> elapsedTOT = std::chrono::high_resolution_clock::now() - startTOT;
+  this->timings_.total = elapsedTOT.count() * 1000;
+}
+
+template <typename TILES, typename BACKEND>
+void CLUEAlgoParallel_T<TILES, BACKEND>::prepareDataStructures(){
+  clue::TraceScope trace("prepareDataStructures", BACKEND::name, this->traceRegion_);
+
+  this->groupPointsByLayer();
+
+  constexpr int nLayers = constants_type_t::nLayers;
+  constexpr int nTiles = constants_type_t::nTiles;
+  if(!binCounts_){
+    binCounts_ = std::make_unique<std::atomic<int>[]>(std::size_t(nLayers) * nTiles);
+    this->tileOffsets_ = std::make_unique<int[]>(std::size_t(nLayers) * nTiles + 1);
+  }
+
+  // the flat tiles are filled in four kernels: count the points of every bin,
+  // turn the counts into offsets, scatter the points and sort every bin as the
+  // sequential fill, so that their content does not depend on the number of threads
+  const auto& points = this->points_;
+  const int n = points.n;
+  std::pmr::vector<int> bins(n, this->resource_);
+  std::pmr::vector<int> slots(n, this->resource_);
+  this->tilePoints_.resize(n);
+  this->flatTiles_ = true;
+  int* offsets = this->tileOffsets_.get();
+
+  BACKEND::parallelFor(n, [&](int idx) {
+    const int i = this->layerPoints_[idx];
+    const auto& lt = this->allLayerTiles_[points.layer[i]];
+    bins[idx] = points.layer[i] * nTiles + geometry_type::globalBin(lt, points, i);
+    binCounts_[bins[idx]].fetch_add(1, std::memory_order_relaxed);
+  });
+  // exclusive scan of the counts of every layer, which starts at the offset of
+  // its points in layerPoints_; the counters of the filled bins become the scatter cursors
+  offsets[std::size_t(nLayers) * nTiles] = n;
+  BACKEND::parallelFor(nLayers, [&](int l) {
+    int offset = this->layerOffsets_[l];
+    for(int g = l * nTiles; g < (l + 1) * nTiles; ++g) {
+      const int count = binCounts_[g].load(std::memory_order_relaxed);
+      offsets[g] = offset;
+      if(count > 0)
+        binCounts_[g].store(offset, std::memory_order_relaxed);
+      offset += count;
+    }
+  });
+  BACKEND::parallelFor(n, [&](int idx) {
+    slots[idx] = binCounts_[bins[idx]].fetch_add(1, std::memory_order_relaxed);
+    this->tilePoints_[slots[idx]] = this->layerPoints_[idx];
+  });
+  // the point in the first slot of every bin sorts it by index (by time with a time
+  // window, see sortTilesByTime) and resets its counter for the next event
+  BACKEND::parallelFor(n, [&](int idx) {
+    const int g = bins[idx];
+    if(slots[idx] != offsets[g])
+      return;
+    const auto begin = this->tilePoints_.begin() + offsets[g];
+    const auto end = this->tilePoints_.begin() + offsets[g + 1];
+    if(this->timeWindow_ > 0.f)
+      std::sort(begin, end, [&](int i, int j) {
+        return points.time[i] < points.time[j] || (points.time[i] == points.time[j] && i < j);
+      });
+    else
+      std::sort(begin, end);
+    binCounts_[g].store(0, std::memory_order_relaxed);
+  });
+}
+
+template <typename TILES, typename BACKEND>
+void CLUEAlgoParallel_T<TILES, BACKEND>::calculateLocalDensity(){
+  clue::TraceScope trace("calculateLocalDensity", BACKEND::name, this->traceRegion_);
+
+  auto& points = this->points_;
+  const float dc = this->dc_;
+  const float dc2 = dc * dc;
+  // work items follow the layers, so that neighbouring items share their tiles
+  BACKEND::parallelFor(points.n, [&](int idx) {
+    const int i = this->layerPoints_[idx];
+    const auto& lt = this->allLayerTiles_[points.layer[i]];
+    const auto search_box = geometry_type::searchBox(lt, points, i, dc);
+
+    float rho_i = 0.f;
+    for(int xBin = search_box[0]; xBin <= search_box[1]; ++xBin) {
+      for(int yBin = search_box[2]; yBin <= search_box[3]; ++yBin) {
+        for(int j : this->binCandidates(this->tileBin(points.layer[i], geometry_type::binId(lt, xBin, yBin)), i)) {
+          if(geometry_type::distance2(points, i, j) <= dc2)
+            rho_i += (i == j ? 1.f : 0.5f) * points.weight[j];
+        }
+      }
+    }
+    points.rho[i] = rho_i;
+  });
+}
+
+template <typename TILES, typename BACKEND>
+void CLUEAlgoParallel_T<TILES, BACKEND>::calculateDistanceToHigher(){
+  clue::TraceScope trace("calculateDistanceToHigher", BACKEND::name, this->traceRegion_);
+
+  // the search of CLUEAlgo_T, which only reads the points and tiles without counters
+  auto& points = this->points_;
+  BACKEND::parallelFor(points.n, [&](int idx) {
+    const int i = this->layerPoints_[idx];
+    std::tie(points.delta[i], points.nearestHigher[i]) = this->searchNearestHigher(points.layer[i], i);
+  });
+}
+
+template <typename TILES, typename BACKEND>
+void CLUEAlgoParallel_T<TILES, BACKEND>::findAndAssignClusters(){
+  clue::TraceScope trace("findAndAssignClusters", BACKEND::name, this->traceRegion_);
+
+  auto& points = this->points_;
+  const float dc = this->dc_;
+  const float rhoc = this->rhoc_;
+  const float dm = this->outlierDeltaFactor_ * this->dc_;
+  auto isSeed = [&](int i) { return (points.delta[i] > dc) && (points.rho[i] >= rhoc); };
+  auto isOutlier = [&](int i) { return (points.delta[i] > dm) && (points.rho[i] < rhoc); };
+
+  // number the seeds of each layer in the order of their points
+  BACKEND::parallelFor(constants_type_t::nLayers, [&](int l) {
+    int nClusters = 0;
+    for(int idx = this->layerOffsets_[l]; idx < this->layerOffsets_[l + 1]; idx++) {
+      const int i = this->layerPoints_[idx];
+      if(isSeed(i)) {
+        points.isSeed[i] = 1;
+        points.clusterIndex[i] = nClusters++;
+      } else {
+        points.clusterIndex[i] = -1;
+      }
+    }
+  });
+
+  // every other point takes the cluster of the seed at the end of its chain
+  // of nearest highers, or stays an outlier if the chain meets an outlier.
+  // Only the points which are not seeds are written, so the chains are stable
+  BACKEND::parallelFor(points.n, [&](int i) {
+    if(points.isSeed[i])
+      return;
+    int j = i;
+    while(j >= 0 && !points.isSeed[j] && !isOutlier(j))
+      j = points.nearestHigher[j];
+    if(j >= 0 && points.isSeed[j])
+      points.clusterIndex[i] = points.clusterIndex[j];
+  });
+}
+
+// explicit template instantiation
+template class CLUEAlgoParallel_T<LayerTiles, clue::backend::Serial>;
+template class CLUEAlgoParallel_T<CLICdetEndcapLayerTiles, clue::backend::Serial>;
+template class CLUEAlgoParallel_T<CLICdetBarrelLayerTiles, clue::backend::Serial>;
+template class CLUEAlgoParallel_T<CLDEndcapLayerTiles, clue::backend::Serial>;
+template class CLUEAlgoParallel_T<CLDBarrelLayerTiles, clue::backend::Serial>;
+template class CLUEAlgoParallel_T<LArBarrelLayerTiles, clue::backend::Serial>;
+
+template class CLUEAlgoParallel_T<LayerTiles, clue::backend::Threads>;
+template class CLUEAlgoParallel_T<CLICdetEndcapLayerTiles, clue::backend::Threads>;
+template class CLUEAlgoParallel_T<CLICdetBarrelLayerTiles, clue::backend::Threads>;
+template class CLUEAlgoParallel_T<CLDEndcapLayerTiles, clue::backend::Threads>;
+template class CLUEAlgoParallel_T<CLDBarrelLayerTiles, clue::backend::Threads>;
+template class CLUEAlgoParallel_T<LArBarrelLayerTiles, clue::backend::Threads>;
+
+template class CLUEAlgoParallel_T<LayerTiles, clue::backend::Tbb>;
+template class CLUEAlgoParallel_T<CLICdetEndcapLayerTiles, clue::backend::Tbb>;
+template class CLUEAlgoParallel_T<CLICdetBarrelLayerTiles, clue::backend::Tbb>;
+template class CLUEAlgoParallel_T<CLDEndcapLayerTiles, clue::backend::Tbb>;
+template class CLUEAlgoParallel_T<CLDBarrelLayerTiles, clue::backend::Tbb>;
+template class CLUEAlgoParallel_T<LArBarrelLayerTiles, clue::backend::Tbb>;
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CLUEAlgoRegistry.h"
+#include "CLUEAlgoParallel.h"
+
+namespace clue {
+
+  namespace {
+    template <typename F>
+    void forEachCLUEBackend(F&& f) {
+      f(std::type_identity<backend::Serial>{});
+      f(std::type_identity<backend::Threads>{});
+      f(std::type_identity<backend::Tbb>{});
+    }
+  } // namespace
+
+  std::unique_ptr<CLUEAlgoBase> makeCLUEAlgo(const std::string& name, float dc, float rhoc, float outlierDeltaFactor,
+                                             bool verbose, bool counters, const std::string& backend) {
+    std::unique_ptr<CLUEAlgoBase> algo;
+    dispatchCLUEAlgo(name, [&](auto tag) {
+      using ALGO = typename decltype(tag)::type;
+      using ALGO_COUNTERS = CLUEAlgo_T<typename ALGO::tiles_type, true>;
+      if (!backend.empty()) {
+        forEachCLUEBackend([&](auto backendTag) {
+          using BACKEND = typename decltype(backendTag)::type;
+          using ALGO_PARALLEL = CLUEAlgoParallel_T<typename ALGO::tiles_type, BACKEND>;
+          if (backend == BACKEND::name)
+            algo = std::make_unique<CLUEAlgoAdapter<ALGO_PARALLEL>>(dc, rhoc, outlierDeltaFactor, verbose);
+        });
+      } else if (counters)
+        algo = std::make_unique<CLUEAlgoAdapter<ALGO_COUNTERS>>(dc, rhoc, outlierDeltaFactor, verbose);
+      else
+        algo = std::make_unique<CLUEAlgoAdapter<ALGO>>(dc, rhoc, outlierDeltaFactor, verbose);
+    });
+    return algo;
+  }
+
+  std::vector<std::string> clueAlgoNames() {
+    std::vector<std::string> names;
+    forEachCLUEAlgo([&](auto, const char* name) { names.push_back(name); });
+    return names;
+  }
+
+  std::vector<std::string> clueBackendNames() {
+    std::vector<std::string> names;
+    forEachCLUEBackend([&](auto tag) { names.push_back(decltype(tag)::type::name); });
+    return names;
+  }
+
+  bool deltaEngineFromName(const std::string& name, CLUEDeltaEngine& engine) {
+    if (name == "Tiles")
+      engine = CLUEDeltaEngine::Tiles;
+    else if (name == "DensitySorted")
+      engine = CLUEDeltaEngine::DensitySorted;
+    else
+      return false;
+    return true;
+  }
+
+  std::vector<std::string> deltaEngineNames() { return {"Tiles", "DensitySorted"}; }
+
+} // namespace clue
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CLUEBackends.h"
+
+namespace clue::backend {
+
+  ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  ThreadPool::~ThreadPool() { resize(0); }
+
+  void ThreadPool::resize(unsigned nWorkers) {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+      worker.join();
+    workers_.clear();
+    stop_ = false;
+    workers_.reserve(nWorkers);
+    for (unsigned i = 0; i < nWorkers; ++i)
+      workers_.emplace_back(&ThreadPool::work, this);
+  }
+
+  void ThreadPool::run(int nChunks, unsigned nThreads, void (*chunk)(const void*, int), const void* context) {
+    std::lock_guard runLock(runMutex_);
+    if (workers_.size() + 1 != std::max(1u, nThreads))
+      resize(std::max(1u, nThreads) - 1);
+    {
+      std::lock_guard lock(mutex_);
+      chunk_ = chunk;
+      context_ = context;
+      nChunks_ = nChunks;
+      nextChunk_.store(0, std::memory_order_relaxed);
+      ++generation_;
+    }
+    wake_.notify_all();
+    runChunks();
+
+    // every chunk was taken by the caller or by a worker that joined, so the
+    // kernel is over once those workers have left; close it for the late ones
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [this] { return activeWorkers_ == 0; });
+    chunk_ = nullptr;
+    context_ = nullptr;
+  }
+
+  void ThreadPool::runChunks() {
+    for (int c = nextChunk_.fetch_add(1, std::memory_order_relaxed); c < nChunks_;
+         c = nextChunk_.fetch_add(1, std::memory_order_relaxed))
+      chunk_(context_, c);
+  }
+
+  void ThreadPool::work() {
+    std::uint64_t seen = 0;
+    std::unique_lock lock(mutex_);
+    while (true) {
+      wake_.wait(lock, [&] { return stop_ || (chunk_ && generation_ != seen); });
+      if (stop_)
+        return;
+      seen = generation_;
+      ++activeWorkers_;
+      lock.unlock();
+      runChunks();
+      lock.lock();
+      if (--activeWorkers_ == 0)
+        done_.notify_one();
+    }
+  }
+
+}  // namespace clue::backend
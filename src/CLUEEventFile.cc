@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CLUEEventFile.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clue {
+
+  using namespace eventfile;
+
+  namespace {
+
+    constexpr std::size_t padded(std::size_t bytes) { return (bytes + alignment - 1) / alignment * alignment; }
+
+    // offsets of the arrays from the beginning of the record
+    struct RecordLayout {
+      explicit RecordLayout(std::size_t n) {
+        const std::size_t arraySize = padded(n * sizeof(float));
+        x = padded(sizeof(RecordHeader));
+        y = x + arraySize;
+        r = y + arraySize;
+        layer = r + arraySize;
+        weight = layer + arraySize;
+        size = weight + arraySize;
+      }
+      std::size_t x, y, r, layer, weight, size;
+    };
+
+    static_assert(sizeof(float) == sizeof(std::int32_t));
+    static_assert(padded(sizeof(FileHeader)) == alignment);
+
+  } // namespace
+
+  bool EventFileWriter::open(const std::string& fileName) {
+    file_.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open())
+      return false;
+    FileHeader header{};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = version;
+    header.recordHeaderSize = sizeof(RecordHeader);
+    char block[alignment] = {};
+    std::memcpy(block, &header, sizeof(header));
+    file_.write(block, alignment);
+    return file_.good();
+  }
+
+  bool EventFileWriter::write(std::uint64_t event, const std::string& region, const std::string& geometry, float dc,
+                              float rhoc, float outlierDeltaFactor, std::size_t n, const float* x, const float* y,
+                              const float* r, const int* layer, const float* weight) {
+    // a truncated name could be the one of another region
+    if (region.size() > maxNameLength || geometry.size() > maxNameLength) {
+      std::cerr << "ERROR: the region " << region << " and the geometry " << geometry << " must have at most "
+                << maxNameLength << " characters to be captured" << std::endl;
+      return false;
+    }
+    const RecordLayout layout(n);
+    RecordHeader header{};
+    header.recordSize = layout.size;
+    header.event = event;
+    header.n = n;
+    region.copy(header.region, maxNameLength);
+    geometry.copy(header.geometry, maxNameLength);
+    header.dc = dc;
+    header.rhoc = rhoc;
+    header.outlierDeltaFactor = outlierDeltaFactor;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open())
+      return false;
+    const char zeros[alignment] = {};
+    auto writeBlock = [&](const void* data, std::size_t bytes) {
+      file_.write(static_cast<const char*>(data), bytes);
+      file_.write(zeros, padded(bytes) - bytes);
+    };
+    writeBlock(&header, sizeof(header));
+    writeBlock(x, n * sizeof(float));
+    writeBlock(y, n * sizeof(float));
+    writeBlock(r, n * sizeof(float));
+    writeBlock(layer, n * sizeof(std::int32_t));
+    writeBlock(weight, n * sizeof(float));
+    return file_.good();
+  }
+
+  bool EventFileReader::open(const std::string& fileName) {
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "ERROR: Failed to open the file " << fileName << std::endl;
+      return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < alignment) {
+      std::cerr << "ERROR: " << fileName << " is not a CLUE capture file" << std::endl;
+      ::close(fd);
+      return false;
+    }
+    size_ = st.st_size;
+    void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      std::cerr << "ERROR: Failed to map the file " << fileName << std::endl;
+      size_ = 0;
+      return false;
+    }
+    data_ = static_cast<const char*>(data);
+
+    FileHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != version ||
+        header.recordHeaderSize != sizeof(RecordHeader)) {
+      std::cerr << "ERROR: " << fileName << " is not a CLUE capture file (version " << version << ")" << std::endl;
+      close();
+      return false;
+    }
+
+    for (std::size_t offset = alignment; offset < size_;) {
+      if (size_ - offset < sizeof(RecordHeader))
+        break;
+      const auto* record = reinterpret_cast<const RecordHeader*>(data_ + offset);
+      const RecordLayout layout(record->n);
+      if (record->recordSize != layout.size || size_ - offset < layout.size) {
+        std::cerr << "WARNING: " << fileName << " is truncated, " << records_.size() << " records read" << std::endl;
+        break;
+      }
+      const char* base = data_ + offset;
+      records_.push_back({record->event,
+                          std::string_view(record->region, strnlen(record->region, sizeof(record->region))),
+                          std::string_view(record->geometry, strnlen(record->geometry, sizeof(record->geometry))),
+                          record->dc,
+                          record->rhoc,
+                          record->outlierDeltaFactor,
+                          record->n,
+                          reinterpret_cast<const float*>(base + layout.x),
+                          reinterpret_cast<const float*>(base + layout.y),
+                          reinterpret_cast<const float*>(base + layout.r),
+                          reinterpret_cast<const std::int32_t*>(base + layout.layer),
+                          reinterpret_cast<const float*>(base + layout.weight)});
+      offset += layout.size;
+    }
+    return true;
+  }
+
+  void EventFileReader::close() {
+    if (data_ != nullptr)
+      ::munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    records_.clear();
+  }
+
+} // namespace clue
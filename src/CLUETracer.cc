@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CLUETracer.h"
+
+#include <fstream>
+
+namespace clue {
+
+  Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  const char* Tracer::intern(const std::string& s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return strings_.insert(s).first->c_str();
+  }
+
+  Tracer::ThreadBuffer& Tracer::threadBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffers_.push_back(std::make_unique<ThreadBuffer>());
+      buffer = buffers_.back().get();
+      buffer->tid = buffers_.size();
+      buffer->events.reserve(1024);
+    }
+    return *buffer;
+  }
+
+  void Tracer::record(const char* name, const char* category, Clock::time_point begin, Clock::time_point end,
+                      const char* region, int layer) {
+    auto& buffer = threadBuffer();
+    if (buffer.events.size() >= maxEventsPerThread) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    buffer.events.push_back({name, category, region, layer,
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(begin - start_).count(),
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()});
+  }
+
+  std::size_t Tracer::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t n = 0;
+    for (const auto& buffer : buffers_)
+      n += buffer->events.size();
+    return n;
+  }
+
+  void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_)
+      buffer->events.clear();
+    dropped_.store(0, std::memory_order_relaxed);
+  }
+
+  bool Tracer::dump(const std::string& fileName) const {
+    std::ofstream oFile(fileName);
+    if (!oFile.is_open())
+      return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // timestamps are in microseconds in the Chrome trace format
+    oFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& buffer : buffers_) {
+      oFile << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+      first = false;
+      for (const auto& e : buffer->events) {
+        oFile << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+              << buffer->tid << ",\"ts\":" << e.begin / 1000 << "." << (e.begin % 1000) / 100
+              << ",\"dur\":" << e.duration / 1000 << "." << (e.duration % 1000) / 100;
+        if (e.region != nullptr || e.layer >= 0) {
+          oFile << ",\"args\":{";
+          if (e.region != nullptr)
+            oFile << "\"region\":\"" << e.region << "\"" << (e.layer >= 0 ? "," : "");
+          if (e.layer >= 0)
+            oFile << "\"layer\":" << e.layer;
+          oFile << "}";
+        }
+        oFile << "}";
+      }
+    }
+    oFile << "\n]}\n";
+    return oFile.good();
+  }
+
+} // namespace clue
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CSVReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clue {
+
+  namespace {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+    public:
+      explicit MappedFile(const std::string& fileName) {
+        fd_ = ::open(fileName.c_str(), O_RDONLY);
+        if (fd_ < 0)
+          return;
+        struct stat st;
+        if (::fstat(fd_, &st) != 0)
+          return;
+        size_ = st.st_size;
+        if (size_ == 0) {
+          ok_ = true;
+          return;
+        }
+        void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED)
+          return;
+        ::madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(data);
+        ok_ = true;
+      }
+      ~MappedFile() {
+        if (data_ != nullptr)
+          ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0)
+          ::close(fd_);
+      }
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+
+      bool ok() const { return ok_; }
+      const char* begin() const { return data_; }
+      const char* end() const { return data_ + size_; }
+
+    private:
+      int fd_ = -1;
+      const char* data_ = nullptr;
+      std::size_t size_ = 0;
+      bool ok_ = false;
+    };
+
+    bool isBlank(const char* begin, const char* end) {
+      return std::all_of(begin, end, [](char c) { return c == ' ' || c == '\t' || c == '\r'; });
+    }
+
+    const char* nextLine(const char* p, const char* end) {
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      return nl == nullptr ? end : nl + 1;
+    }
+
+    // end of the content of a line, given the start of the next one
+    const char* lineEnd(const char* next) { return next[-1] == '\n' ? next - 1 : next; }
+
+    // parses the next field and moves p past the following separator
+    bool parseField(const char*& p, const char* end, float& value) {
+      while (p < end && (*p == ' ' || *p == '\t' || *p == '+'))
+        ++p;
+      auto [ptr, ec] = std::from_chars(p, end, value);
+      if (ec != std::errc())
+        return false;
+      p = ptr;
+      while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+      if (p < end && *p == ',')
+        ++p;
+      return true;
+    }
+
+    // upper bound on the number of rows: blank lines are counted as well
+    std::size_t countLines(const char* begin, const char* end) {
+      return std::count(begin, end, '\n') + (end > begin && end[-1] != '\n');
+    }
+
+    // parses the rows in [begin, end) into points, starting from row `offset`;
+    // nRows is set to the number of (non blank) rows parsed
+    bool parseRows(const char* begin, const char* end, int nColumns, std::size_t offset, InputPoints& points,
+                   std::size_t& nRows) {
+      std::size_t row = offset;
+      for (const char* p = begin; p < end;) {
+        const char* next = nextLine(p, end);
+        const char* last = lineEnd(next);
+        if (!isBlank(p, last)) {
+          float values[5] = {0.f, 0.f, 0.f, 0.f, 0.f};
+          const char* q = p;
+          for (int c = 0; c < nColumns; ++c) {
+            if (!parseField(q, last, values[c])) {
+              std::cerr << "ERROR: malformed csv line: " << std::string(p, std::min<std::size_t>(last - p, 80))
+                        << std::endl;
+              return false;
+            }
+          }
+          points.x[row] = values[0];
+          points.y[row] = values[1];
+          points.layer[row] = std::lround(values[2]);
+          points.weight[row] = values[3];
+          points.r[row] = values[4];
+          ++row;
+        }
+        p = next;
+      }
+      nRows = row - offset;
+      return true;
+    }
+
+  } // namespace
+
+  bool readCSV(const std::string& fileName, InputPoints& points, int nLayerCopies, unsigned nThreads) {
+    points.clear();
+
+    MappedFile file(fileName);
+    if (!file.ok()) {
+      std::cerr << "ERROR: Failed to open the file " << fileName << std::endl;
+      return false;
+    }
+    const char* begin = file.begin();
+    const char* end = file.end();
+
+    // skip the header, if any, and count the columns on the first data line
+    while (begin < end && isBlank(begin, lineEnd(nextLine(begin, end))))
+      begin = nextLine(begin, end);
+    if (begin < end && !(std::isdigit(static_cast<unsigned char>(*begin)) || *begin == '-' || *begin == '+' || *begin == '.'))
+      begin = nextLine(begin, end);
+    if (begin == end)
+      return true;
+    const char* firstLineEnd = nextLine(begin, end);
+    const int nColumns = 1 + std::count(begin, firstLineEnd, ',');
+    if (nColumns != 4 && nColumns != 5) {
+      std::cerr << "ERROR: expected 4 or 5 columns (x,y,layer,weight[,r]) in " << fileName << ", found "
+                << nColumns << std::endl;
+      return false;
+    }
+
+    // split the file in chunks at line boundaries
+    nThreads = std::max(1u, nThreads);
+    std::vector<const char*> bounds{begin};
+    for (unsigned t = 1; t < nThreads; ++t) {
+      const char* p = std::max(bounds.back(), begin + (end - begin) * t / nThreads);
+      bounds.push_back(p == begin ? p : nextLine(p - 1, end));
+    }
+    bounds.push_back(end);
+
+    auto forEachChunk = [&](auto&& f) {
+      if (nThreads == 1) {
+        f(0);
+        return;
+      }
+      std::vector<std::thread> pool;
+      for (unsigned t = 0; t < nThreads; ++t)
+        pool.emplace_back(f, t);
+      for (auto& th : pool)
+        th.join();
+    };
+
+    // first pass: count the lines of each chunk to know where to write them
+    std::vector<std::size_t> offsets(nThreads + 1, 0);
+    forEachChunk([&](unsigned t) { offsets[t + 1] = countLines(bounds[t], bounds[t + 1]); });
+    for (unsigned t = 0; t < nThreads; ++t)
+      offsets[t + 1] += offsets[t];
+
+    const std::size_t nCopies = std::max(1, nLayerCopies);
+    points.x.resize(offsets.back() * nCopies);
+    points.y.resize(offsets.back() * nCopies);
+    points.r.resize(offsets.back() * nCopies);
+    points.layer.resize(offsets.back() * nCopies);
+    points.weight.resize(offsets.back() * nCopies);
+
+    // second pass: parse
+    std::vector<char> status(nThreads, 1);
+    std::vector<std::size_t> parsed(nThreads, 0);
+    forEachChunk([&](unsigned t) {
+      status[t] = parseRows(bounds[t], bounds[t + 1], nColumns, offsets[t], points, parsed[t]);
+    });
+    if (std::find(status.begin(), status.end(), 0) != status.end()) {
+      points.clear();
+      return false;
+    }
+
+    // close the gaps left by blank lines, if any
+    std::size_t nRows = parsed[0];
+    for (unsigned t = 1; t < nThreads; ++t) {
+      if (nRows != offsets[t]) {
+        auto move = [&](auto& v) { std::copy_n(v.begin() + offsets[t], parsed[t], v.begin() + nRows); };
+        move(points.x);
+        move(points.y);
+        move(points.r);
+        move(points.layer);
+        move(points.weight);
+      }
+      nRows += parsed[t];
+    }
+
+    // replicate the points on the following layers
+    for (std::size_t l = 1; l < nCopies; ++l) {
+      const std::size_t shift = l * nRows;
+      std::copy_n(points.x.begin(), nRows, points.x.begin() + shift);
+      std::copy_n(points.y.begin(), nRows, points.y.begin() + shift);
+      std::copy_n(points.r.begin(), nRows, points.r.begin() + shift);
+      std::copy_n(points.weight.begin(), nRows, points.weight.begin() + shift);
+      std::transform(points.layer.begin(), points.layer.begin() + nRows, points.layer.begin() + shift,
+                     [l](int layer) { return layer + static_cast<int>(l); });
+    }
+    points.x.resize(nRows * nCopies);
+    points.y.resize(nRows * nCopies);
+    points.r.resize(nRows * nCopies);
+    points.layer.resize(nRows * nCopies);
+    points.weight.resize(nRows * nCopies);
+
+    return true;
+  }
+
+} // namespace clue
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "CellIDDecoder.h"
+
+#include <charconv>
+#include <stdexcept>
+
+namespace clue {
+
+  namespace {
+
+    int toInt(std::string_view s, std::string_view encoding) {
+      int value = 0;
+      auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+      if (ec != std::errc() || ptr != s.data() + s.size())
+        throw std::invalid_argument("CellIDDecoder: bad field '" + std::string(s) + "' in '" + std::string(encoding) + "'");
+      return value;
+    }
+
+  } // namespace
+
+  CellIDDecoder::CellIDDecoder(std::string_view encoding) {
+    unsigned nextOffset = 0;
+    std::size_t begin = 0;
+    while (begin < encoding.size()) {
+      auto end = encoding.find(',', begin);
+      if (end == std::string_view::npos)
+        end = encoding.size();
+      auto field = encoding.substr(begin, end - begin);
+      begin = end + 1;
+      if (field.find_first_not_of(" \t") == std::string_view::npos)
+        continue;
+
+      std::vector<std::string_view> tokens;
+      std::size_t tokenBegin = 0;
+      for (;;) {
+        auto colon = field.find(':', tokenBegin);
+        auto token = field.substr(tokenBegin, colon - tokenBegin);
+        auto first = token.find_first_not_of(" \t");
+        auto last = token.find_last_not_of(" \t");
+        tokens.push_back(first == std::string_view::npos ? std::string_view() : token.substr(first, last - first + 1));
+        if (colon == std::string_view::npos)
+          break;
+        tokenBegin = colon + 1;
+      }
+
+      int offset = nextOffset;
+      int width = 0;
+      if (tokens.size() == 2) {
+        width = toInt(tokens[1], encoding);
+      } else if (tokens.size() == 3) {
+        offset = toInt(tokens[1], encoding);
+        width = toInt(tokens[2], encoding);
+      } else {
+        throw std::invalid_argument("CellIDDecoder: bad field '" + std::string(field) + "' in '" + std::string(encoding) + "'");
+      }
+
+      unsigned absWidth = width < 0 ? -width : width;
+      if (tokens[0].empty() || absWidth == 0 || offset < 0 || offset + absWidth > 64)
+        throw std::invalid_argument("CellIDDecoder: bad field '" + std::string(field) + "' in '" + std::string(encoding) + "'");
+
+      std::uint64_t mask = absWidth == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << absWidth) - 1;
+      fields_.push_back({std::string(tokens[0]), unsigned(offset), absWidth, width < 0, mask});
+      nextOffset = offset + absWidth;
+    }
+  }
+
+  int CellIDDecoder::index(std::string_view name) const {
+    for (std::size_t i = 0; i < fields_.size(); ++i)
+      if (fields_[i].name == name)
+        return i;
+    return -1;
+  }
+
+  std::int64_t CellIDDecoder::get(std::uint64_t cellID, std::string_view name) const {
+    int i = index(name);
+    if (i < 0)
+      throw std::out_of_range("CellIDDecoder: no field '" + std::string(name) + "'");
+    return get(cellID, i);
+  }
+
+} // namespace clue
@@ -18,11 +18,14 @@
  */
 #include "ClueGaudiAlgorithmWrapper.h"
 
+#include "CLUEClusterBuilder.h"
 #include "IO_helper.h"
 
 // podio specific includes
 #include "DDSegmentation/BitFieldCoder.h"
 
+#include <tbb/task_group.h>
+
 using namespace dd4hep ;
 using namespace DDSegmentation ;
 using namespace std;
@@ -31,152 +34,276 @@ DECLARE_COMPONENT(ClueGaudiAlgorithmWrapper)
 
 ClueGaudiAlgorithmWrapper::ClueGaudiAlgorithmWrapper(const std::string& name, ISvcLocator* pSL) :
   Gaudi::Algorithm(name, pSL) {
-  declareProperty("BarrelCaloHitsCollection", EB_calo_handle, "Collection for Barrel Calo Hits used in input");
-  declareProperty("EndcapCaloHitsCollection", EE_calo_handle, "Collection for Endcap Calo Hits used in input");
+  // The input handles follow the collection names, so that they are declared
+  // before the scheduler collects the data dependencies of the algorithm
+  for(auto* property : {
+        declareProperty("BarrelCaloHitsCollection", barrelCollection, "Collection for Barrel Calo Hits used in input, if InputCollections is empty"),
+        declareProperty("EndcapCaloHitsCollection", endcapCollection, "Collection for Endcap Calo Hits used in input, if InputCollections is empty"),
+        declareProperty("InputCollections", inputCollections, "Calo hits collections used in input, each clustered on its own")})
+    property->declareUpdateHandler([this](Gaudi::Details::PropertyBase&) { declareInputHandles(); });
+  declareInputHandles();
+  declareProperty("Geometries", geometries, "CLUE geometry of each of the InputCollections (CLICdetBarrel, CLICdetEndcap, CLDBarrel, ...)");
   declareProperty("CriticalDistance", dc, "Used to compute the local density");
   declareProperty("MinLocalDensity", rhoc, "Minimum local density for a point to be promoted as a Seed");
   declareProperty("OutlierDeltaFactor", outlierDeltaFactor, "Multiplicative constant to be applied to CriticalDistance");
+  declareProperty("CriticalDistances", criticalDistances, "CriticalDistance of each of the InputCollections, if empty CriticalDistance is used");
+  declareProperty("MinLocalDensities", minLocalDensities, "MinLocalDensity of each of the InputCollections, if empty MinLocalDensity is used");
+  declareProperty("OutlierDeltaFactors", outlierDeltaFactors, "OutlierDeltaFactor of each of the InputCollections, if empty OutlierDeltaFactor is used");
+  declareProperty("DeltaEngines", deltaEngines, "Nearest-higher search of each of the InputCollections (Tiles or DensitySorted), if empty Tiles is used");
+  declareProperty("EnergyThreshold", energyThreshold, "If positive, CLUE only clusters the hits with at least this energy, the others are outliers");
+  declareProperty("EnergyThresholds", energyThresholds, "EnergyThreshold of each of the InputCollections, if empty EnergyThreshold is used");
+  declareProperty("ThresholdW0", thresholdW0, "Log-weight threshold of the cluster positions, the hits with less than exp(-ThresholdW0) of the cluster energy do not contribute");
+  declareProperty("TimeWindow", timeWindow, "If positive, two hits are neighbours in CLUE only if their times differ by less than this");
+  declareProperty("NeighbourCacheMB", neighbourCacheMB, "If positive, CLUE searches the tiles once and keeps the neighbours in at most this many MB per collection");
+  declareProperty("CapSeedDelta", capSeedDelta, "If true, the nearest higher of the hits with rho >= MinLocalDensity is only searched within CriticalDistance (same clusters, but seeds keep an infinite delta)");
+  declareProperty("Backend", backend, "If not empty, run the parallel CLUE kernels on this backend (Serial, Threads or Tbb)");
   declareProperty("OutClusters", clustersHandle, "Clusters collection (output)");
   declareProperty("OutCaloHits", caloHitsHandle, "Calo hits collection created from Clusters (output)");
+  declareProperty("TraceFile", traceFile, "If not empty, record the CLUE phases and dump them in this Chrome trace JSON file at finalize");
+  declareProperty("CaptureFile", captureFile, "If not empty, write the CLUE inputs of every event in this binary file (see clue_replay)");
+}
+
+void ClueGaudiAlgorithmWrapper::declareInputHandles() {
+  cellIDHandles_.clear();
+  for(auto& handle : caloHandles_)
+    renounce(*handle);
+  caloHandles_.clear();
+  const auto collections = inputCollections.empty() ? std::vector<std::string>{barrelCollection, endcapCollection}
+                                                    : inputCollections;
+  for(const auto& collection : collections){
+    caloHandles_.push_back(std::make_unique<DataHandle<edm4hep::CalorimeterHitCollection>>(collection, Gaudi::DataHandle::Reader, this));
+    cellIDHandles_.push_back(std::make_unique<MetaDataHandle<std::string>>(*caloHandles_.back(), edm4hep::labels::CellIDEncoding, Gaudi::DataHandle::Reader));
+  }
 }
 
 StatusCode ClueGaudiAlgorithmWrapper::initialize() {
 
-  bool clue_verbose = false;
-  if (msgLevel(MSG::INFO) || msgLevel(MSG::DEBUG)){
-    clue_verbose = true;
+  if(!traceFile.empty()){
+    clue::Tracer::instance().enable();
+    info() << "Tracing the CLUE phases into " << traceFile << endmsg;
   }
 
-  auto start = std::chrono::high_resolution_clock::now();
-  clueAlgoBarrel_ = CLICdetBarrelCLUEAlgo(dc, rhoc, outlierDeltaFactor, clue_verbose);
-  auto finish = std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double> elapsed = finish - start;
-  info() << "ClueGaudiAlgorithmWrapper: Set up time (Barrel): " << elapsed.count() * 1000 << " ms" << endmsg;
+  if(!captureFile.empty()){
+    if(!captureWriter_.open(captureFile)){
+      error() << "Could not open the capture file " << captureFile << endmsg;
+      return StatusCode::FAILURE;
+    }
+    info() << "Capturing the CLUE inputs into " << captureFile << endmsg;
+  }
+
+  // Without InputCollections, cluster the ECAL barrel and endcap as before
+  std::vector<std::string> names;
+  if(inputCollections.empty()){
+    names = {"Barrel", "Endcap"};
+    inputCollections = {barrelCollection, endcapCollection};
+    if(geometries.empty())
+      geometries = {"CLICdetBarrel", "CLICdetEndcap"};
+  } else {
+    names = inputCollections;
+  }
+
+  const auto nRegions = inputCollections.size();
+  auto checkSize = [&](const std::string& property, size_t size, bool optional){
+    if(size == nRegions || (optional && size == 0))
+      return true;
+    error() << property << " has " << size << " entries, but there are " << nRegions << " InputCollections" << endmsg;
+    return false;
+  };
+  if(!checkSize("Geometries", geometries.size(), false) ||
+     !checkSize("CriticalDistances", criticalDistances.size(), true) ||
+     !checkSize("MinLocalDensities", minLocalDensities.size(), true) ||
+     !checkSize("OutlierDeltaFactors", outlierDeltaFactors.size(), true) ||
+     !checkSize("DeltaEngines", deltaEngines.size(), true) ||
+     !checkSize("EnergyThresholds", energyThresholds.size(), true))
+    return StatusCode::FAILURE;
+
+  regions_.clear();
+  for(size_t i = 0; i < nRegions; i++){
+    auto region = std::make_unique<Region>();
+    region->name = names[i];
+    region->collection = inputCollections[i];
+    region->geometry = geometries[i];
+    region->dc = criticalDistances.empty() ? dc : criticalDistances[i];
+    region->rhoc = minLocalDensities.empty() ? rhoc : minLocalDensities[i];
+    region->outlierDeltaFactor = outlierDeltaFactors.empty() ? outlierDeltaFactor : outlierDeltaFactors[i];
+
+    auto start = std::chrono::high_resolution_clock::now();
+    region->clueAlgo = clue::makeCLUEAlgo(region->geometry, region->dc, region->rhoc, region->outlierDeltaFactor,
+                                          false, clueCounters, backend);
+    auto finish = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = finish - start;
+    if(!region->clueAlgo){
+      error() << "Unknown CLUE geometry " << region->geometry << " for " << region->collection << " or backend " << backend
+              << ", available geometries:";
+      for(const auto& name : clue::clueAlgoNames())
+        error() << " " << name;
+      error() << ", backends:";
+      for(const auto& name : clue::clueBackendNames())
+        error() << " " << name;
+      error() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    region->clueAlgo->setTraceRegion(region->name);
+    region->clueAlgo->setTimeWindow(timeWindow);
+    if(!region->clueAlgo->setNeighbourCache(std::size_t(std::max(neighbourCacheMB, 0)) << 20)){
+      error() << "NeighbourCacheMB is not supported by the " << backend << " backend, used for " << region->collection
+              << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if(!region->clueAlgo->setCapSeedDelta(capSeedDelta)){
+      error() << "CapSeedDelta is not supported by the " << backend << " backend, used for " << region->collection
+              << endmsg;
+      return StatusCode::FAILURE;
+    }
+    region->clueAlgo->setEnergyThreshold(energyThresholds.empty() ? energyThreshold : energyThresholds[i]);
+    if(!deltaEngines.empty()){
+      CLUEDeltaEngine engine;
+      if(!clue::deltaEngineFromName(deltaEngines[i], engine)){
+        error() << "Unknown DeltaEngine " << deltaEngines[i] << " for " << region->collection << ", available engines:";
+        for(const auto& name : clue::deltaEngineNames())
+          error() << " " << name;
+        error() << endmsg;
+        return StatusCode::FAILURE;
+      }
+      if(!region->clueAlgo->setDeltaEngine(engine)){
+        error() << "DeltaEngine " << deltaEngines[i] << " is not supported by the " << backend << " backend, used for "
+                << region->collection << endmsg;
+        return StatusCode::FAILURE;
+      }
+    }
+    region->traceRegion = clue::Tracer::instance().intern(region->name);
+    info() << "ClueGaudiAlgorithmWrapper: Set up time (" << region->name << ", " << region->geometry << "): "
+           << elapsed.count() * 1000 << " ms" << endmsg;
+
+    region->caloHandle = caloHandles_[i].get();
+    region->cellIDHandle = cellIDHandles_[i].get();
+    if(captureWriter_.isOpen() && (region->name.size() > clue::eventfile::maxNameLength ||
+                                   region->geometry.size() > clue::eventfile::maxNameLength)){
+      error() << "The collection " << region->name << " and the geometry " << region->geometry << " must have at most "
+              << clue::eventfile::maxNameLength << " characters to be captured in " << captureFile << endmsg;
+      return StatusCode::FAILURE;
+    }
+    regions_.push_back(std::move(region));
+  }
 
-  start = std::chrono::high_resolution_clock::now();
-  clueAlgoEndcap_ = CLICdetEndcapCLUEAlgo(dc, rhoc, outlierDeltaFactor, clue_verbose);
-  finish = std::chrono::high_resolution_clock::now();
-  elapsed = finish - start;
-  info() << "ClueGaudiAlgorithmWrapper: Set up time (Endcap): " << elapsed.count() * 1000 << " ms" << endmsg;
+  for(const auto& region : regions_){
+    for(const std::string phase : latencyPhases){
+      const auto key = region->name + " " + phase + " [ms]";
+      latencyCounters_.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(this, key));
+    }
+  }
+
+  if(clueCounters){
+    for(const auto& regionPtr : regions_){
+      const std::string& region = regionPtr->name;
+      for(const std::string pass : {"density", "distanceToHigher"}){
+        for(const std::string name : {"binsVisited", "emptyBinsVisited", "distancesEvaluated", "acceptedNeighbours"}){
+          const auto key = region + " " + pass + " " + name;
+          clueCounters_.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(this, key));
+        }
+      }
+      for(const std::string name : {"maxTileOccupancy", "meanTileOccupancy"}){
+        const auto key = region + " " + name;
+        clueCounters_.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(this, key));
+      }
+    }
+  }
 
   return Algorithm::initialize();
 
 }
 
-void ClueGaudiAlgorithmWrapper::exclude_stats_outliers(std::vector<float> &v) {
-  if (v.size() == 1)
-    return;
-  float mean = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
-  float sum_sq_diff = std::accumulate(
-      v.begin(), v.end(), 0.0,
-      [mean](float acc, float val) { return acc + (val - mean) * (val - mean); });
-  float stddev = std::sqrt(sum_sq_diff / (v.size() - 1));
-  std::cout << "Sigma cut outliers: " << stddev << std::endl;
-  float z_score_threshold = 3.0;
-  v.erase(std::remove_if(v.begin(), v.end(),
-                         [mean, stddev, z_score_threshold](float val) {
-            float z_score = std::abs(val - mean) / stddev;
-            return z_score > z_score_threshold;
-          }),
-          v.end());
-}
+void ClueGaudiAlgorithmWrapper::fillCLUEHits(Region& region) const{
 
-std::pair<float, float> ClueGaudiAlgorithmWrapper::stats(const std::vector<float> &v) {
-  float m = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
-  float sum = std::accumulate(v.begin(), v.end(), 0.0, [m](float acc, float val) {
-    return acc + (val - m) * (val - m);
-  });
-  auto den = v.size() > 1 ? (v.size() - 1) : v.size();
-  return {m, std::sqrt(sum / den)};
-}
+  const BitFieldCoder bf(region.cellIDstr);
+  auto& clue_hits = region.clueHits.vect;
+  clue_hits.reserve(region.caloColl->size());
 
-void ClueGaudiAlgorithmWrapper::printTimingReport(std::vector<float> &vals, int repeats,
-                       const std::string label) {
-  int precision = 2;
-  float mean = 0.f;
-  float sigma = 0.f;
-  exclude_stats_outliers(vals);
-  tie(mean, sigma) = stats(vals);
-  std::cout << label << " 1 outliers(" << repeats << "/" << vals.size() << ") "
-            << std::fixed << std::setprecision(precision) << mean << " +/- "
-            << sigma << " [ms]" << std::endl;
-  exclude_stats_outliers(vals);
-  tie(mean, sigma) = stats(vals);
-  std::cout << label << " 2 outliers(" << repeats << "/" << vals.size() << ") "
-            << std::fixed << std::setprecision(precision) << mean << " +/- "
-            << sigma << " [ms]" << std::endl;
-}
+  if(!region.clueAlgo->endcap()){
+    for(const auto& calo_hit : (*region.caloColl) ){
+      clue_hits.push_back(clue::CLUECalorimeterHit(calo_hit.clone(), clue::CLUECalorimeterHit::DetectorRegion::barrel, bf.get( calo_hit.getCellID(), "layer")));
+    }
+    return;
+  }
 
+  // The layers of the endcap geometries include both sides,
+  // e.g. 80 = 2 x 40 in `include/CLICdetEndcapLayerTilesConstants.h`
+  const int maxLayerPerSide = region.clueAlgo->nLayers() / 2;
+  for(const auto& calo_hit : (*region.caloColl) ){
+    if(bf.get( calo_hit.getCellID(), "side") < 0 || bf.get( calo_hit.getCellID(), "side") > 1){
+      clue_hits.push_back(clue::CLUECalorimeterHit(calo_hit.clone(), clue::CLUECalorimeterHit::DetectorRegion::endcap, bf.get( calo_hit.getCellID(), "layer")));
+    } else {
+      clue_hits.push_back(clue::CLUECalorimeterHit(calo_hit.clone(), clue::CLUECalorimeterHit::DetectorRegion::endcap, bf.get( calo_hit.getCellID(), "layer") + maxLayerPerSide));
+    }
+  }
+}
 
-void ClueGaudiAlgorithmWrapper::fillCLUEPoints(std::vector<clue::CLUECalorimeterHit>& clue_hits) const{
+void ClueGaudiAlgorithmWrapper::fillCLUEPoints(Region& region) const{
 
-  for (const auto& ch : clue_hits) {
+  // the inputs of the previous event are kept until now, CLUE reads them in place
+  cleanCLUEPoints(region);
+  for (const auto& ch : region.clueHits.vect) {
     if(ch.inBarrel()){
-      x.push_back(ch.getPhi()*ch.getR());
-      y.push_back(ch.getPosition().z);
-      r.push_back(ch.getR());
+      region.x.push_back(ch.getPhi()*ch.getR());
+      region.y.push_back(ch.getPosition().z);
+      region.r.push_back(ch.getR());
     } else {
-      x.push_back(ch.getPosition().x);
-      y.push_back(ch.getPosition().y);
+      region.x.push_back(ch.getPosition().x);
+      region.y.push_back(ch.getPosition().y);
       // For the endcap the r info is not mandatory because it is not used
-      r.push_back(ch.getR());
+      region.r.push_back(ch.getR());
     }
-    layer.push_back(ch.getLayer());
-    weight.push_back(ch.getEnergy());
+    region.layer.push_back(ch.getLayer());
+    region.weight.push_back(ch.getEnergy());
+    region.time.push_back(ch.getTime());
   }
   return;
 
 }
 
-std::map<int, std::vector<int> > ClueGaudiAlgorithmWrapper::runAlgo(std::vector<clue::CLUECalorimeterHit>& clue_hits, 
-								    bool isBarrel = false) const {
+// Runs concurrently for all the regions: errors are stored in the region
+// and reported by execute, as the message service is not used from here
+void ClueGaudiAlgorithmWrapper::runAlgo(Region& region, std::uint64_t eventNumber) const {
 
-  std::map<int, std::vector<int> > clueClusters;
-  Points cluePoints;
+  auto& clue_hits = region.clueHits.vect;
 
   // Fill CLUE inputs
-  fillCLUEPoints(clue_hits);
+  {
+    clue::TraceScope trace("fillCLUEPoints", "ClueGaudiAlgorithmWrapper", region.traceRegion);
+    fillCLUEPoints(region);
+  }
 
-  // Run CLUE
-  info() << "Running CLUEAlgo ... " << endmsg;
-  if(isBarrel){
-    info() << "... in the barrel" << endmsg;
+  if(captureWriter_.isOpen()){
+    if(!captureWriter_.write(eventNumber, region.name, region.geometry, region.dc, region.rhoc, region.outlierDeltaFactor,
+                             region.x.size(), region.x.data(), region.y.data(), region.r.data(), region.layer.data(), region.weight.data()))
+      region.error = "Could not capture the CLUE inputs of event " + std::to_string(eventNumber);
+  }
 
-    if(clueAlgoBarrel_.clearAndSetPoints(x.size(), &x[0], &y[0], &layer[0], &weight[0], &r[0]))
-      throw error() << "Error in setting the clue points for the barrel." << endmsg;
+  // Run CLUE
+  {
+    clue::TraceScope trace("run", "ClueGaudiAlgorithmWrapper", region.traceRegion);
+    auto& clueAlgo = *region.clueAlgo;
+
+    if(clueAlgo.clearAndSetPoints(region.x.size(), region.x.data(), region.y.data(), region.layer.data(),
+                                  region.weight.data(), region.r.data(), region.time.data())){
+      region.error = "Error in setting the clue points for " + region.name + ".";
+      cleanCLUEPoints(region);
+      return;
+    }
 
     // measure excution time of makeClusters
     auto start = std::chrono::high_resolution_clock::now();
-    clueAlgoBarrel_.makeClusters();
-    auto finish = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = finish - start;
-    debug() << "ClueGaudiAlgorithmWrapper (barrel): Elapsed time: " << elapsed.count() * 1000 << " ms" << endmsg;
-
-    clueClusters = clueAlgoBarrel_.getClusters();
-    cluePoints = clueAlgoBarrel_.getPoints();
-    clueAlgoBarrel_.clearLayerTiles();
-
-  } else {
-    info() << "... in the endcap" << endmsg;
-
-    if(clueAlgoEndcap_.clearAndSetPoints(x.size(), &x[0], &y[0], &layer[0], &weight[0], &r[0]))
-      throw error() << "Error in setting the clue points for the endcap." << endmsg;
-
-    auto start = std::chrono::high_resolution_clock::now();
-    clueAlgoEndcap_.makeClusters();
+    clueAlgo.makeClusters();
     auto finish = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> elapsed = finish - start;
-    //std::cout << "Iteration " << rep;
-    debug() << "ClueGaudiAlgorithmWrapper (endcap): Elapsed time: " << elapsed.count() * 1000 << " ms" << endmsg;
+    region.elapsed = elapsed.count() * 1000;
 
-    clueClusters = clueAlgoEndcap_.getClusters();
-    cluePoints = clueAlgoEndcap_.getPoints();
-    clueAlgoEndcap_.clearLayerTiles();
+    region.clueClusters.emplace(clueAlgo.getClusters());
+    clueAlgo.clearLayerTiles();
   }
 
-  info() << "Finished running CLUE algorithm" << endmsg;
-
   // Including CLUE info in cluePoints
+  const Points& cluePoints = region.clueAlgo->getPoints();
   for(size_t i = 0; i < cluePoints.n; i++){
 
     clue_hits[i].setRho(cluePoints.rho[i]);
@@ -200,218 +327,143 @@ std::map<int, std::vector<int> > ClueGaudiAlgorithmWrapper::runAlgo(std::vector<
     }
 
   }
-
-  // Clean CLUE inputs
-  cleanCLUEPoints();
-
-  return clueClusters;
 }
 
-void ClueGaudiAlgorithmWrapper::cleanCLUEPoints() const{
-  x.clear();
-  y.clear();
-  r.clear();
-  layer.clear();
-  weight.clear();
-}
-
-void ClueGaudiAlgorithmWrapper::fillFinalClusters(std::vector<clue::CLUECalorimeterHit>& clue_hits, 
-                                                  const std::map<int, std::vector<int> > clusterMap, 
-                                                  edm4hep::ClusterCollection* clusters) const{
+void ClueGaudiAlgorithmWrapper::fillCLUECounters(const std::string& region, const CLUECounters& counters) const{
 
-  for(auto cl : clusterMap){
+  auto fillSearch = [&](const std::string& pass, const CLUESearchCounters& c){
+    clueCounters_.at(region + " " + pass + " binsVisited") += c.binsVisited;
+    clueCounters_.at(region + " " + pass + " emptyBinsVisited") += c.emptyBinsVisited;
+    clueCounters_.at(region + " " + pass + " distancesEvaluated") += c.distancesEvaluated;
+    clueCounters_.at(region + " " + pass + " acceptedNeighbours") += c.acceptedNeighbours;
+  };
+  fillSearch("density", counters.localDensity);
+  fillSearch("distanceToHigher", counters.distanceToHigher);
 
-    // Outliers should not create a cluster
-    if(cl.first == -1){
+  // tile occupancy is filled once per non-empty layer
+  for(size_t l = 0; l < counters.maxTileOccupancy.size(); l++){
+    if(counters.maxTileOccupancy[l] == 0)
       continue;
-    }
-
-    std::map<int, std::vector<int> > clustersLayer;
-    for(auto index : cl.second){
-      clustersLayer[clue_hits[index].getLayer()].push_back(index);
-    }
-
-    for(auto clLay : clustersLayer){
-
-      auto cluster = clusters->create();
-      unsigned int maxEnergyIndex = 0;
-      float maxEnergyValue = 0.f;
-
-      for(auto index : clLay.second){
-
-        if(clue_hits[index].inBarrel()){
-          cluster.addToHits(EB_calo_coll->at(index));
-        }
-        if(clue_hits[index].inEndcap()){
-          cluster.addToHits(EE_calo_coll->at(index));
-        }
-        
-        if (clue_hits[index].getEnergy() > maxEnergyValue) {
-          maxEnergyValue = clue_hits[index].getEnergy();
-          maxEnergyIndex = index;
-        }
-      }
-      float energy = 0.f;
-      float sumEnergyErrSquared = 0.f;
-      std::for_each(cluster.getHits().begin(), cluster.getHits().end(),
-                    [&energy, &sumEnergyErrSquared] (edm4hep::CalorimeterHit elem) { 
-                      energy += elem.getEnergy(); 
-                      sumEnergyErrSquared += pow(elem.getEnergyError()/(1.*elem.getEnergy()), 2);
-                    });
-      cluster.setEnergy(energy);
-      cluster.setEnergyError(sqrt(sumEnergyErrSquared));
-
-      calculatePosition(&cluster);
-
-      //JUST A PLACEHOLDER FOR NOW: TO BE FIXED
-      cluster.setPositionError({0.00, 0.00, 0.00, 0.00, 0.00, 0.00});
-      cluster.setType(clue_hits[maxEnergyIndex].getType());
-    }
-    clustersLayer.clear();
+    clueCounters_.at(region + " maxTileOccupancy") += counters.maxTileOccupancy[l];
+    clueCounters_.at(region + " meanTileOccupancy") += counters.meanTileOccupancy[l];
   }
+}
 
-  return;
+void ClueGaudiAlgorithmWrapper::cleanCLUEPoints(Region& region) const{
+  region.x.clear();
+  region.y.clear();
+  region.r.clear();
+  region.layer.clear();
+  region.weight.clear();
+  region.time.clear();
 }
 
-void ClueGaudiAlgorithmWrapper::calculatePosition(edm4hep::MutableCluster* cluster) const {
-
-  float total_weight = cluster->getEnergy();
-  if(total_weight <= 0)
-    warning() << "Zero energy in the cluster" << endmsg;
-
-  float total_weight_log = 0.f;
-  float x_log = 0.f;
-  float y_log = 0.f;
-  float z_log = 0.f;
-  double thresholdW0_ = 2.9; //Min percentage of energy to contribute to the log-reweight position
-
-  for (size_t i = 0; i < cluster->hits_size(); i++) {
-    float rhEnergy = cluster->getHits(i).getEnergy();
-    float Wi = std::max(thresholdW0_ - std::log(rhEnergy / total_weight), 0.);
-    x_log += cluster->getHits(i).getPosition().x * Wi;
-    y_log += cluster->getHits(i).getPosition().y * Wi;
-    z_log += cluster->getHits(i).getPosition().z * Wi;
-    total_weight_log += Wi;
-  }
+void ClueGaudiAlgorithmWrapper::fillLatency(Region& region, double buildElapsed) const{
 
-  if (total_weight_log != 0.) {
-    float inv_tot_weight_log = 1.f / total_weight_log;
-    cluster->setPosition({x_log * inv_tot_weight_log, y_log * inv_tot_weight_log, z_log * inv_tot_weight_log});
+  const auto& timings = region.clueAlgo->getTimings();
+  const double values[] = {timings.prepareDataStructures, timings.calculateLocalDensity,
+                           timings.calculateDistanceToHigher, timings.findSeedAndFollowers,
+                           timings.assignClusters, timings.total, region.elapsed, region.taskElapsed, buildElapsed};
+  static_assert(std::size(values) == latencyPhases.size());
+  for(std::size_t p = 0; p < latencyPhases.size(); p++){
+    region.latency[p].recordMs(values[p]);
+    latencyCounters_.at(region.name + " " + latencyPhases[p] + " [ms]") += values[p];
   }
-
-  return;
 }
 
-void ClueGaudiAlgorithmWrapper::transformClustersInCaloHits(edm4hep::ClusterCollection* clusters,
-                                                            edm4hep::CalorimeterHitCollection* caloHits) const{
-
-  float time = 0.f;
-  float maxEnergy = 0.f;
-  std::uint64_t maxEnergyCellID = 0;
-
-  for(auto cl : *clusters){
-    auto caloHit = caloHits->create();
-    caloHit.setEnergy(cl.getEnergy());
-    caloHit.setEnergyError(cl.getEnergyError());
-    caloHit.setPosition(cl.getPosition());
-    caloHit.setType(cl.getType());
-
-    time = 0.0;
-    maxEnergy = 0.0;
-    maxEnergyCellID = 0;
-    for(auto hit : cl.getHits()){
-      time += hit.getTime();
-      if (hit.getEnergy() > maxEnergy) {
-        maxEnergy = hit.getEnergy();
-        maxEnergyCellID = hit.getCellID();
-      }
-    }
-    caloHit.setCellID(maxEnergyCellID);
-    caloHit.setTime(time/cl.hits_size());
-  }
+void ClueGaudiAlgorithmWrapper::fillFinalClusters(Region& region, edm4hep::ClusterCollection* clusters) const{
 
-  return;
+  const auto& layer = region.clueAlgo->getPoints().layer;
+  int nZeroEnergy = clue::fillFinalClusters(*region.caloColl, std::span<const int>(layer.data(), layer.size()),
+                                            *region.clueClusters, *clusters, thresholdW0,
+                                            region.eventArena.resource());
+  if(nZeroEnergy > 0)
+    warning() << "Zero energy in " << nZeroEnergy << " clusters" << endmsg;
 }
 
-StatusCode ClueGaudiAlgorithmWrapper::execute(const EventContext&) const {
+StatusCode ClueGaudiAlgorithmWrapper::execute(const EventContext& ctx) const {
 
-  // Read EB and EE collection
-  EB_calo_coll = EB_calo_handle.get();
-  EE_calo_coll = EE_calo_handle.get();
+  // Release the memory of the previous event: the algos give it back first
+  for(auto& region : regions_){
+    region->clueClusters.reset();
+    region->clueAlgo->setMemoryResource(std::pmr::null_memory_resource());
+    region->eventArena.reset();
+    region->clueAlgo->setMemoryResource(region->eventArena.resource());
+  }
 
-  // Get collection metadata cellID which is valid for both EB and EE
-  const auto cellIDstr = cellIDHandle.get();
-  const BitFieldCoder bf(cellIDstr);
+  // Read the input collections and their cellID encoding
+  for(auto& region : regions_){
+    region->caloColl = region->caloHandle->get();
+    if(!region->caloColl->isValid())
+      throw std::runtime_error("Collection " + region->collection + " not found.");
+    region->cellIDstr = region->cellIDHandle->get();
+    region->clueHits.vect.clear();
+    region->error.clear();
+  }
 
   // Output CLUE clusters
   // edm4hep::ClusterCollection* finalClusters = clustersHandle.createAndPut();
   auto finalClusters = std::make_unique<edm4hep::ClusterCollection>();
 
-  // Output CLUE calo hits
-  clue::CLUECalorimeterHitCollection clue_hit_coll_barrel;
-  clue::CLUECalorimeterHitCollection clue_hit_coll_endcap;
-
-  debug() << "ClueGaudiAlgorithmWrapper: Number of calo hits: " << int(EB_calo_coll->size()+EE_calo_coll->size()) << std::endl;
-  info() << EB_calo_coll->size() << " caloHits in ECAL Barrel." << endmsg;
-
-  // Fill CLUECaloHits in the barrel
-  if( EB_calo_coll->isValid() ) {
-    for(const auto& calo_hit : (*EB_calo_coll) ){
-      // Cut on a specific layer for noise studies
-      //if(bf.get( calo_hit.getCellID(), "layer") == 6){
-        clue_hit_coll_barrel.vect.push_back(clue::CLUECalorimeterHit(calo_hit.clone(), clue::CLUECalorimeterHit::DetectorRegion::barrel, bf.get( calo_hit.getCellID(), "layer")));
-      //}
-    }
-  } else {
-    throw std::runtime_error("Collection not found.");
-  }
-
-  // Run CLUE in the barrel
-  if(!clue_hit_coll_barrel.vect.empty()){
-
-    std::map<int, std::vector<int> > clueClustersBarrel = runAlgo(clue_hit_coll_barrel.vect, true);
-    debug() << "Produced " << clueClustersBarrel.size() << " clusters in ECAL Barrel" << endmsg;
-  
-    clue_hit_coll.vect.insert(clue_hit_coll.vect.end(), clue_hit_coll_barrel.vect.begin(), clue_hit_coll_barrel.vect.end());
-
-    fillFinalClusters(clue_hit_coll_barrel.vect, clueClustersBarrel, finalClusters.get());
-    info() << "Saved " << finalClusters->size() << " clusters using ECAL Barrel hits" << endmsg;
-
+  // Cluster all the regions concurrently, each one with its own algo and memory
+  tbb::task_group regionTasks;
+  for(auto& regionPtr : regions_){
+    Region& region = *regionPtr;
+    regionTasks.run([this, &region, &ctx] {
+      auto start = std::chrono::high_resolution_clock::now();
+      {
+        clue::TraceScope trace("fill", "ClueGaudiAlgorithmWrapper", region.traceRegion);
+        fillCLUEHits(region);
+      }
+      if(!region.clueHits.vect.empty())
+        runAlgo(region, ctx.evt());
+      std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+      region.taskElapsed = elapsed.count() * 1000;
+    });
   }
-
-  // Total amount of EE+ and EE- layers (80)
-  // already described in `include/CLDEndcapLayerTilesConstants.h` 
-  int maxLayerPerSide = 40;
-
-  info() << EE_calo_coll->size() << " caloHits in ECAL Endcap." << endmsg;
-
-  // Fill CLUECaloHits in the endcap
-  if( EE_calo_coll->isValid() ) {
-    for(const auto& calo_hit : (*EE_calo_coll) ){
-      if(bf.get( calo_hit.getCellID(), "side") < 0 || bf.get( calo_hit.getCellID(), "side") > 1){
-        clue_hit_coll_endcap.vect.push_back(clue::CLUECalorimeterHit(calo_hit.clone(), clue::CLUECalorimeterHit::DetectorRegion::endcap, bf.get( calo_hit.getCellID(), "layer")));
-      } else { 
-        clue_hit_coll_endcap.vect.push_back(clue::CLUECalorimeterHit(calo_hit.clone(), clue::CLUECalorimeterHit::DetectorRegion::endcap, bf.get( calo_hit.getCellID(), "layer") + maxLayerPerSide));
+  regionTasks.wait();
+
+  for(auto& regionPtr : regions_){
+    Region& region = *regionPtr;
+    info() << region.caloColl->size() << " caloHits in " << region.collection << "." << endmsg;
+    if(!region.error.empty()){
+      if(!region.clueClusters){
+        error() << region.error << endmsg;
+        return StatusCode::FAILURE;
       }
+      warning() << region.error << endmsg;
     }
-  } else {
-    throw std::runtime_error("Collection not found.");
-  }
+    if(!region.clueClusters)
+      continue;
 
-  // Run CLUE in the endcap
-  if(!clue_hit_coll_endcap.vect.empty()){
-    std::map<int, std::vector<int> > clueClustersEndcap = runAlgo(clue_hit_coll_endcap.vect, false);
-    debug() << "Produced " << clueClustersEndcap.size() << " clusters in ECAL Endcap" << endmsg;
-  
-    clue_hit_coll.vect.insert(clue_hit_coll.vect.end(), clue_hit_coll_endcap.vect.begin(), clue_hit_coll_endcap.vect.end());
+    debug() << "ClueGaudiAlgorithmWrapper (" << region.name << "): Elapsed time: " << region.elapsed << " ms" << endmsg;
+    // CLUE runs quietly in the region tasks, its phases are reported here
+    if(msgLevel(MSG::INFO)){
+      const auto& timings = region.clueAlgo->getTimings();
+      info() << "ClueGaudiAlgorithmWrapper (" << region.name << "): prepareDataStructures " << timings.prepareDataStructures
+             << " ms, calculateLocalDensity " << timings.calculateLocalDensity
+             << " ms, calculateDistanceToHigher " << timings.calculateDistanceToHigher
+             << " ms, findSeedAndFollowers " << timings.findSeedAndFollowers
+             << " ms, assignClusters " << timings.assignClusters << " ms, TOT " << timings.total << " ms" << endmsg;
+    }
+    debug() << "Produced " << region.clueClusters->size() << " clusters in " << region.collection << endmsg;
+    if(clueCounters)
+      fillCLUECounters(region.name, region.clueAlgo->getCounters());
 
-    fillFinalClusters(clue_hit_coll_endcap.vect, clueClustersEndcap, finalClusters.get());
-    info() << "Saved " << finalClusters->size() << " clusters using ECAL Endcap hits" << endmsg;
+    clue::TraceScope trace("build", "ClueGaudiAlgorithmWrapper", region.traceRegion);
+    auto start = std::chrono::high_resolution_clock::now();
+    clue_hit_coll.vect.insert(clue_hit_coll.vect.end(), region.clueHits.vect.begin(), region.clueHits.vect.end());
 
+    fillFinalClusters(region, finalClusters.get());
+    std::chrono::duration<double> buildElapsed = std::chrono::high_resolution_clock::now() - start;
+    fillLatency(region, buildElapsed.count() * 1000);
+    info() << "Saved " << finalClusters->size() << " clusters using " << region.collection << " hits" << endmsg;
   }
 
   info() << "Saved " << finalClusters->size() << " CLUE clusters in total." << endmsg;
 
+  clue::TraceScope traceRegister("register", "ClueGaudiAlgorithmWrapper");
+
   // Save CLUE calo hits
   auto pCHV = std::make_unique<clue::CLUECalorimeterHitCollection>(clue_hit_coll);
   const StatusCode scStatusV = eventSvc()->registerObject("/Event/CLUECalorimeterHitCollection", pCHV.release());
@@ -423,7 +475,7 @@ StatusCode ClueGaudiAlgorithmWrapper::execute(const EventContext&) const {
 
   // Save clusters as calo hits and add cellID to them
   auto finalCaloHits = std::make_unique<edm4hep::CalorimeterHitCollection>();
-  transformClustersInCaloHits(finalClusters.get(), finalCaloHits.get());
+  clue::transformClustersInCaloHits(*finalClusters, *finalCaloHits);
   info() << "Saved " << finalCaloHits->size() << " clusters as calo hits" << endmsg;
 
   // Only now can we put the collections into the event store, as nothing needs
@@ -436,11 +488,59 @@ StatusCode ClueGaudiAlgorithmWrapper::execute(const EventContext&) const {
 
   // Cleaning
   clue_hit_coll.vect.clear();
-  cleanCLUEPoints();
 
   return StatusCode::SUCCESS;
 }
 
 StatusCode ClueGaudiAlgorithmWrapper::finalize() {
+
+  for(const auto& region : regions_){
+    const auto& arena = region->eventArena;
+    info() << "CLUE event arena (" << region->name << "): " << arena.capacity() / 1024 << " kB, grown " << arena.growths()
+           << " times, " << arena.heapAllocations() << " allocations (" << arena.heapBytes() / 1024
+           << " kB) did not fit in it" << endmsg;
+  }
+
+  if(captureWriter_.isOpen())
+    captureWriter_.close();
+
+  if(!traceFile.empty()){
+    auto& tracer = clue::Tracer::instance();
+    if(tracer.dump(traceFile)){
+      info() << "Written " << tracer.size() << " trace events to " << traceFile;
+      if(tracer.dropped() > 0)
+        info() << " (" << tracer.dropped() << " dropped)";
+      info() << endmsg;
+    } else {
+      warning() << "Could not write the trace file " << traceFile << endmsg;
+    }
+  }
+
+  info() << "CLUE latency per event [ms]:" << endmsg;
+  for(const auto& region : regions_){
+    for(std::size_t p = 0; p < latencyPhases.size(); p++){
+      const auto& latency = region->latency[p];
+      if(latency.count() == 0)
+        continue;
+      info() << "  " << std::left << std::setw(40) << (region->name + " " + latencyPhases[p]) << std::right
+             << std::fixed << std::setprecision(3)
+             << " p50 " << std::setw(10) << latency.percentile(0.50) * 1e-6
+             << " p95 " << std::setw(10) << latency.percentile(0.95) * 1e-6
+             << " p99 " << std::setw(10) << latency.percentile(0.99) * 1e-6
+             << " max " << std::setw(10) << latency.max() * 1e-6
+             << std::defaultfloat << std::setprecision(6) << " events " << latency.count() << endmsg;
+    }
+  }
+
+  if(clueCounters){
+    info() << "CLUE hot-path counters (per event, per non-empty layer for the tile occupancy):" << endmsg;
+    for(const auto& [name, counter] : clueCounters_){
+      info() << "  " << std::left << std::setw(48) << name << std::right
+             << " mean " << std::setw(14) << counter.mean()
+             << " max " << std::setw(14) << counter.max()
+             << " entries " << counter.nEntries() << endmsg;
+    }
+  }
+
   return Algorithm::finalize();
 }
@@ -20,6 +20,10 @@
 #define CLUE_GAUDI_ALGORITHM_WRAPPER_H
 
 #include <Gaudi/Algorithm.h>
+#include <Gaudi/Accumulators.h>
+
+#include <memory>
+#include <optional>
 
 // FWCore
 #include "k4FWCore/DataHandle.h"
@@ -29,7 +33,17 @@
 #include <edm4hep/ClusterCollection.h>
 #include <edm4hep/Constants.h>
 #include "CLUECalorimeterHit.h"
-#include "CLUEAlgo.h"
+#include "CLUEAlgoRegistry.h"
+#include "CLUEEventFile.h"
+#include "EventArena.h"
+#include "LatencyHistogram.h"
+
+// Hot-path counters of CLUE are compiled out unless K4CLUE_COUNTERS is defined
+#ifdef K4CLUE_COUNTERS
+constexpr bool clueCounters = true;
+#else
+constexpr bool clueCounters = false;
+#endif
 
 class ClueGaudiAlgorithmWrapper : public Gaudi::Algorithm {
 public:
@@ -39,47 +53,99 @@ public:
   virtual StatusCode finalize() override final;
   virtual StatusCode initialize() override final;
 
-  // Timing analysis
-  void exclude_stats_outliers(std::vector<float> &v);
-  std::pair<float, float> stats(const std::vector<float> &v) ;
-  void printTimingReport(std::vector<float> &vals, int repeats,
-                       const std::string label) ;
-
-  void fillCLUEPoints(std::vector<clue::CLUECalorimeterHit>& clue_hits) const;
-  std::map<int, std::vector<int> > runAlgo(std::vector<clue::CLUECalorimeterHit>& clue_hits, 
-                                           bool isBarrel) const;
-  void cleanCLUEPoints() const;
-  void fillFinalClusters(std::vector<clue::CLUECalorimeterHit>& clue_hits,
-                         const std::map<int, std::vector<int> > clusterMap, 
-                         edm4hep::ClusterCollection* clusters) const;
-  void calculatePosition(edm4hep::MutableCluster* cluster) const ;
-  void transformClustersInCaloHits(edm4hep::ClusterCollection* clusters,
-                                 edm4hep::CalorimeterHitCollection* caloHits) const;
+  // Phases whose latency is histogrammed per region: the ones of CLUETimings, makeClusters as seen
+  // by the wrapper, the whole clustering task of the region and the building of its clusters
+  static constexpr std::array<const char*, 9> latencyPhases{
+      "prepareDataStructures", "calculateLocalDensity", "calculateDistanceToHigher", "findSeedAndFollowers",
+      "assignClusters", "clueTotal", "makeClusters", "region", "build"};
+
+  // One input collection, clustered with its own geometry and parameters
+  struct Region {
+    std::string name;
+    std::string collection;
+    std::string geometry;
+    float dc;
+    float rhoc;
+    float outlierDeltaFactor;
+    const char* traceRegion = nullptr;
+
+    DataHandle<edm4hep::CalorimeterHitCollection>* caloHandle = nullptr;
+    MetaDataHandle<std::string>* cellIDHandle = nullptr;
+
+    // Per-event memory of CLUE, declared before the algo which uses it
+    clue::EventArena eventArena;
+    std::unique_ptr<clue::CLUEAlgoBase> clueAlgo;
+
+    // Per-event inputs and results
+    const edm4hep::CalorimeterHitCollection* caloColl = nullptr;
+    std::string cellIDstr;
+    clue::CLUECalorimeterHitCollection clueHits;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> r;
+    std::vector<int> layer;
+    std::vector<float> weight;
+    std::vector<float> time;
+    std::optional<CLUEClusterMap> clueClusters;
+    double elapsed = 0.;
+    double taskElapsed = 0.;
+    std::string error;
+
+    // Latency of each of the latencyPhases, over the events
+    std::array<clue::LatencyHistogram, latencyPhases.size()> latency;
+  };
+
+  // (re)creates the input handles whenever the collection names change
+  void declareInputHandles();
+  void fillCLUEHits(Region& region) const;
+  void fillCLUEPoints(Region& region) const;
+  void runAlgo(Region& region, std::uint64_t eventNumber) const;
+  void cleanCLUEPoints(Region& region) const;
+  void fillCLUECounters(const std::string& region, const CLUECounters& counters) const;
+  void fillLatency(Region& region, double buildElapsed) const;
+  void fillFinalClusters(Region& region, edm4hep::ClusterCollection* clusters) const;
 
   private:
   // Parameters in input
-  mutable const edm4hep::CalorimeterHitCollection* EB_calo_coll;
-  mutable const edm4hep::CalorimeterHitCollection* EE_calo_coll;
+  std::string barrelCollection{"BarrelInputHits"};
+  std::string endcapCollection{"EndcapInputHits"};
+  std::vector<std::string> inputCollections;
+  std::vector<std::string> geometries;
+  std::vector<float> criticalDistances;
+  std::vector<float> minLocalDensities;
+  std::vector<float> outlierDeltaFactors;
+  std::vector<std::string> deltaEngines;
+  std::vector<float> energyThresholds;
   float dc;
   float rhoc;
   float outlierDeltaFactor;
+  std::string backend;
+  float thresholdW0 = 2.9f;
+  float energyThreshold = 0.f;
+  float timeWindow = 0.f;
+  int neighbourCacheMB = 0;
+  bool capSeedDelta = false;
+  std::string traceFile;
+  std::string captureFile;
 
   // CLUE points
   mutable clue::CLUECalorimeterHitCollection clue_hit_coll;
-  mutable std::vector<float> x;
-  mutable std::vector<float> y;
-  mutable std::vector<float> r;
-  mutable std::vector<int> layer;
-  mutable std::vector<float> weight;
-
-  // Handle to read the calo cells and their cellID 
-  mutable DataHandle<edm4hep::CalorimeterHitCollection> EB_calo_handle {"BarrelInputHits", Gaudi::DataHandle::Reader, this};
-  mutable DataHandle<edm4hep::CalorimeterHitCollection> EE_calo_handle {"EndcapInputHits", Gaudi::DataHandle::Reader, this};
-  MetaDataHandle<std::string> cellIDHandle {EB_calo_handle, edm4hep::labels::CellIDEncoding, Gaudi::DataHandle::Reader};
-
-  // CLUE Algo
-  mutable CLICdetBarrelCLUEAlgo clueAlgoBarrel_;
-  mutable CLICdetEndcapCLUEAlgo clueAlgoEndcap_;
+
+  // Handles of the input collections (InputCollections, or the barrel and endcap ones) and of their cellID encoding
+  std::vector<std::unique_ptr<DataHandle<edm4hep::CalorimeterHitCollection>>> caloHandles_;
+  std::vector<std::unique_ptr<MetaDataHandle<std::string>>> cellIDHandles_;
+
+  // Input collections with their handles and CLUE algos, clustered concurrently
+  std::vector<std::unique_ptr<Region>> regions_;
+
+  // Capture of the CLUE inputs, replayed with clue_replay
+  mutable clue::EventFileWriter captureWriter_;
+
+  // CLUE hot-path counters, per region
+  mutable std::map<std::string, Gaudi::Accumulators::StatCounter<double>> clueCounters_;
+
+  // Latencies in ms, per region and phase, also kept in the Region histograms for the percentiles
+  mutable std::map<std::string, Gaudi::Accumulators::StatCounter<double>> latencyCounters_;
 
   // Collections in output
   mutable DataHandle<edm4hep::CalorimeterHitCollection> caloHitsHandle{"CLUEClustersAsHits", Gaudi::DataHandle::Writer, this};
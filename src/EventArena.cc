@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "EventArena.h"
+
+namespace clue {
+
+  void* CountingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    ++allocations_;
+    bytes_ += bytes;
+    return upstream_->allocate(bytes, alignment);
+  }
+
+  void CountingResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+    upstream_->deallocate(p, bytes, alignment);
+  }
+
+  EventArena::EventArena(std::size_t initialSize)
+      : size_(initialSize), buffer_(std::make_unique_for_overwrite<std::byte[]>(initialSize)) {
+    arena_.emplace(buffer_.get(), size_, &heap_);
+  }
+
+  void EventArena::reset() {
+    const std::size_t overflow = heap_.bytes() - heapBytesAtReset_;
+    // gives the overflow chunks back to the heap
+    arena_.reset();
+    if (overflow > 0) {
+      size_ += overflow;
+      buffer_ = std::make_unique_for_overwrite<std::byte[]>(size_);
+      ++growths_;
+    }
+    heapBytesAtReset_ = heap_.bytes();
+    arena_.emplace(buffer_.get(), size_, &heap_);
+  }
+
+} // namespace clue
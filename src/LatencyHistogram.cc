@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace clue {
+
+  std::size_t LatencyHistogram::binOf(std::uint64_t ns) {
+    constexpr std::uint64_t sub = std::uint64_t(1) << subBits;
+    if (ns < sub)
+      return ns;
+    // shift such that ns >> shift is in [sub, 2 sub)
+    const int shift = std::bit_width(ns) - 1 - subBits;
+    const std::size_t bin = (std::size_t(shift + 1) << subBits) + ((ns >> shift) - sub);
+    return std::min(bin, nBins - 1);
+  }
+
+  std::uint64_t LatencyHistogram::binUpperEdge(std::size_t bin) {
+    constexpr std::uint64_t sub = std::uint64_t(1) << subBits;
+    if (bin < sub)
+      return bin;
+    const int shift = int(bin >> subBits) - 1;
+    const std::uint64_t lower = (sub + (bin & (sub - 1))) << shift;
+    return lower + (std::uint64_t(1) << shift) - 1;
+  }
+
+  void LatencyHistogram::record(std::uint64_t ns) {
+    bins_[binOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(ns, std::memory_order_relaxed);
+    std::uint64_t max = max_.load(std::memory_order_relaxed);
+    while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+      ;
+  }
+
+  void LatencyHistogram::recordMs(double ms) { record(std::uint64_t(std::llround(std::max(ms, 0.) * 1e6))); }
+
+  void LatencyHistogram::reset() {
+    for (auto& bin : bins_)
+      bin.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  double LatencyHistogram::mean() const {
+    const std::uint64_t n = count();
+    return n > 0 ? double(sum_.load(std::memory_order_relaxed)) / n : 0.;
+  }
+
+  std::uint64_t LatencyHistogram::percentile(double q) const {
+    const std::uint64_t n = count();
+    if (n == 0)
+      return 0;
+    // rank of the entry, from 1 to n
+    const auto rank = std::clamp<std::uint64_t>(std::uint64_t(std::ceil(q * n)), 1, n);
+    std::uint64_t seen = 0;
+    for (std::size_t bin = 0; bin < nBins; ++bin) {
+      seen += bins_[bin].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        return std::min(binUpperEdge(bin), max());
+    }
+    return max();
+  }
+
+} // namespace clue
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TimingStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <tuple>
+
+namespace clue {
+
+  void exclude_stats_outliers(std::vector<float> &v) {
+    if (v.size() == 1)
+      return;
+    float mean = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+    float sum_sq_diff = std::accumulate(
+        v.begin(), v.end(), 0.0,
+        [mean](float acc, float val) { return acc + (val - mean) * (val - mean); });
+    float stddev = std::sqrt(sum_sq_diff / (v.size() - 1));
+    std::cout << "Sigma cut outliers: " << stddev << std::endl;
+    float z_score_threshold = 3.0;
+    v.erase(std::remove_if(v.begin(), v.end(),
+                           [mean, stddev, z_score_threshold](float val) {
+              float z_score = std::abs(val - mean) / stddev;
+              return z_score > z_score_threshold;
+            }),
+            v.end());
+  }
+
+  std::pair<float, float> stats(const std::vector<float> &v) {
+    float m = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+    float sum = std::accumulate(v.begin(), v.end(), 0.0, [m](float acc, float val) {
+      return acc + (val - m) * (val - m);
+    });
+    auto den = v.size() > 1 ? (v.size() - 1) : v.size();
+    return {m, std::sqrt(sum / den)};
+  }
+
+  void printTimingReport(std::vector<float> &vals, int repeats, const std::string& label) {
+    int precision = 2;
+    float mean = 0.f;
+    float sigma = 0.f;
+    exclude_stats_outliers(vals);
+    std::tie(mean, sigma) = stats(vals);
+    std::cout << label << " 1 outliers(" << repeats << "/" << vals.size() << ") "
+              << std::fixed << std::setprecision(precision) << mean << " +/- "
+              << sigma << " [ms]" << std::endl;
+    exclude_stats_outliers(vals);
+    std::tie(mean, sigma) = stats(vals);
+    std::cout << label << " 2 outliers(" << repeats << "/" << vals.size() << ") "
+              << std::fixed << std::setprecision(precision) << mean << " +/- "
+              << sigma << " [ms]" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+  }
+
+} // namespace clue
@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Scaling benchmark of CLUEAlgo_T on synthetic events: per-phase time,
+// throughput and peak memory as a function of the number of hits and of
+// the number of threads, for every registered detector geometry.
+//
+// Each thread owns its own CLUEAlgo_T instance and clusters the same set
+// of pre-generated events, i.e. the thread scaling measured here is the
+// event-level one obtained when running several CLUE instances in parallel.
+// With --backend, CLUEAlgoParallel_T also splits every event over the
+// threads of its backend.
+// With --scanDc, the benchmark instead compares CLUEAlgo_T::scanCriticalDistances()
+// with one makeClusters() per critical distance, on a single thread.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "CLUEAlgoParallel.h"
+#include "CLUEAlgoRegistry.h"
+#include "EventGenerator.h"
+
+namespace {
+
+  struct Options {
+    std::vector<std::string> geometries;
+    std::vector<std::size_t> hits{1000, 10000, 100000, 1000000, 10000000};
+    std::vector<unsigned> threads;
+    unsigned events = 3;
+    float dc = 15.f;
+    float rhoc = 0.02f;
+    float outlierDeltaFactor = 3.f;
+    std::uint64_t seed = 42;
+    bool csv = false;
+    std::string traceFile;
+    std::string backend;
+    std::vector<float> scanDc;
+    std::size_t neighbourCacheMB = 0;
+    bool capSeedDelta = false;
+    CLUEDeltaEngine deltaEngine = CLUEDeltaEngine::Tiles;
+    float energyThreshold = 0.f;
+  };
+
+  template <typename T>
+  std::vector<T> parseList(const std::string& s) {
+    std::vector<T> values;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      values.push_back(static_cast<T>(std::stod(item)));
+    return values;
+  }
+
+  void usage(const char* name) {
+    std::cout << "Usage: " << name << " [options]\n"
+              << "  --geometry NAME     geometry to run on (repeatable, default: all)\n"
+              << "  --hits N1,N2,...    number of hits per event (default: 1e3..1e7)\n"
+              << "  --threads T1,T2,... number of threads (default: 1,2,4,... up to the number of cores)\n"
+              << "  --events N          number of events clustered by each thread (default: 3)\n"
+              << "  --dc, --rhoc, --outlierDeltaFactor  CLUE parameters (default: 15, 0.02, 3)\n"
+              << "  --seed S            generator seed (default: 42)\n"
+              << "  --csv               print the results as csv\n"
+              << "  --trace FILE        record the CLUE phases in a Chrome trace JSON file\n"
+              << "  --backend NAME      run CLUEAlgoParallel_T on this backend (Serial, Threads or Tbb)\n"
+              << "  --scanDc D1,D2,...  time one scanCriticalDistances() against one run per critical distance\n"
+              << "  --neighbourCache MB search the tiles once per event, keeping the neighbours in at most MB\n"
+              << "  --capSeedDelta      search the nearest higher of the points with rho >= rhoc only within dc\n"
+              << "  --deltaEngine NAME  nearest-higher search, Tiles or DensitySorted (default: Tiles)\n"
+              << "  --energyThreshold E only cluster the hits with a weight of at least E, the others are outliers\n";
+  }
+
+  // Linux only: reset and read the peak resident set size of the process
+  void resetPeakRSS() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs.is_open())
+      clearRefs << "5";
+  }
+
+  double peakRSSMB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+      if (line.rfind("VmHWM:", 0) == 0)
+        return std::stod(line.substr(6)) / 1024.;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.;
+  }
+
+  struct Result {
+    CLUETimings timings;
+    double clearLayerTiles = 0.;
+    double wallTime = 0.;
+    double peakRSS = 0.;
+    unsigned runs = 0;
+  };
+
+  template <typename ALGO>
+  Result runConfiguration(const Options& opt, const std::vector<clue::InputPoints>& inputs, unsigned nThreads) {
+    std::vector<std::unique_ptr<ALGO>> algos;
+    for (unsigned t = 0; t < nThreads; ++t) {
+      algos.push_back(std::make_unique<ALGO>(opt.dc, opt.rhoc, opt.outlierDeltaFactor, false));
+      algos.back()->setTraceRegion(std::to_string(inputs.front().size()) + " hits, " + std::to_string(nThreads) + " threads");
+      algos.back()->neighbourCacheBytes_ = opt.neighbourCacheMB << 20;
+      algos.back()->capSeedDelta_ = opt.capSeedDelta;
+      algos.back()->deltaEngine_ = opt.deltaEngine;
+      algos.back()->energyThreshold_ = opt.energyThreshold;
+    }
+    std::vector<Result> partial(nThreads);
+
+    auto worker = [&](unsigned t) {
+      auto& algo = *algos[t];
+      auto& res = partial[t];
+      for (unsigned e = 0; e < opt.events; ++e) {
+        const auto& in = inputs[(t + e) % inputs.size()];
+        algo.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+        algo.makeClusters();
+        auto start = std::chrono::high_resolution_clock::now();
+        algo.clearLayerTiles();
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        const auto& tm = algo.getTimings();
+        res.timings.prepareDataStructures += tm.prepareDataStructures;
+        res.timings.calculateLocalDensity += tm.calculateLocalDensity;
+        res.timings.calculateDistanceToHigher += tm.calculateDistanceToHigher;
+        res.timings.findSeedAndFollowers += tm.findSeedAndFollowers;
+        res.timings.assignClusters += tm.assignClusters;
+        res.timings.total += tm.total;
+        res.clearLayerTiles += elapsed.count() * 1000;
+        ++res.runs;
+      }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < nThreads; ++t)
+      pool.emplace_back(worker, t);
+    for (auto& th : pool)
+      th.join();
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    Result res;
+    for (const auto& p : partial) {
+      res.timings.prepareDataStructures += p.timings.prepareDataStructures;
+      res.timings.calculateLocalDensity += p.timings.calculateLocalDensity;
+      res.timings.calculateDistanceToHigher += p.timings.calculateDistanceToHigher;
+      res.timings.findSeedAndFollowers += p.timings.findSeedAndFollowers;
+      res.timings.assignClusters += p.timings.assignClusters;
+      res.timings.total += p.timings.total;
+      res.clearLayerTiles += p.clearLayerTiles;
+      res.runs += p.runs;
+    }
+    res.wallTime = elapsed.count() * 1000;
+    res.peakRSS = peakRSSMB();
+    return res;
+  }
+
+  // CLUEAlgo_T, or CLUEAlgoParallel_T on the backend of the options
+  template <typename ALGO>
+  Result runBackend(const Options& opt, const std::vector<clue::InputPoints>& inputs, unsigned nThreads) {
+    using TILES = typename ALGO::tiles_type;
+    if (opt.backend == clue::backend::Serial::name)
+      return runConfiguration<CLUEAlgoParallel_T<TILES, clue::backend::Serial>>(opt, inputs, nThreads);
+    if (opt.backend == clue::backend::Threads::name)
+      return runConfiguration<CLUEAlgoParallel_T<TILES, clue::backend::Threads>>(opt, inputs, nThreads);
+    if (opt.backend == clue::backend::Tbb::name)
+      return runConfiguration<CLUEAlgoParallel_T<TILES, clue::backend::Tbb>>(opt, inputs, nThreads);
+    return runConfiguration<ALGO>(opt, inputs, nThreads);
+  }
+
+  // mean time per event [ms] of one run per dc and of a single scan over all of them
+  template <typename ALGO>
+  void runScanDc(const Options& opt, const std::vector<clue::InputPoints>& inputs, const std::string& geometry,
+                 std::size_t hits) {
+    ALGO scanAlgo(opt.dc, opt.rhoc, opt.outlierDeltaFactor, false);
+    std::vector<std::unique_ptr<ALGO>> algos;
+    for (auto dc : opt.scanDc)
+      algos.push_back(std::make_unique<ALGO>(dc, opt.rhoc, opt.outlierDeltaFactor, false));
+
+    double independent = 0.;
+    double scan = 0.;
+    bool same = true;
+    for (unsigned e = 0; e < opt.events; ++e) {
+      const auto& in = inputs[e % inputs.size()];
+      auto start = std::chrono::high_resolution_clock::now();
+      for (auto& algo : algos) {
+        algo->clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+        algo->makeClusters();
+        algo->clearLayerTiles();
+      }
+      std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+      independent += elapsed.count() * 1000;
+
+      start = std::chrono::high_resolution_clock::now();
+      scanAlgo.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+      const auto results = scanAlgo.scanCriticalDistances(opt.scanDc);
+      scanAlgo.clearLayerTiles();
+      elapsed = std::chrono::high_resolution_clock::now() - start;
+      scan += elapsed.count() * 1000;
+
+      // the scan returns the dcs in increasing order, and each algo keeps its points until the next event
+      for (const auto& res : results) {
+        const auto k = std::find(opt.scanDc.begin(), opt.scanDc.end(), res.dc) - opt.scanDc.begin();
+        const auto& clusterIndex = algos[k]->points_.clusterIndex;
+        same = same && std::equal(clusterIndex.begin(), clusterIndex.end(), res.clusterIndex.begin(),
+                                  res.clusterIndex.end());
+      }
+    }
+    independent /= opt.events;
+    scan /= opt.events;
+    if (opt.csv) {
+      std::cout << geometry << "," << hits << "," << opt.scanDc.size() << "," << independent << "," << scan << ","
+                << independent / scan << "," << same << "\n";
+      return;
+    }
+    std::cout << std::left << std::setw(15) << geometry << std::right << std::setw(10) << hits << std::setw(8)
+              << opt.scanDc.size() << std::fixed << std::setprecision(3) << std::setw(16) << independent
+              << std::setw(11) << scan << std::setprecision(2) << std::setw(10) << independent / scan
+              << std::setw(8) << (same ? "yes" : "NO") << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+
+  void printHeader(bool csv) {
+    if (csv) {
+      std::cout << "geometry,hits,threads,prepare_ms,density_ms,delta_ms,seeds_ms,assign_ms,total_ms,"
+                << "clear_ms,events_per_s,hits_per_s,peak_rss_mb\n";
+      return;
+    }
+    std::cout << std::left << std::setw(15) << "geometry" << std::right << std::setw(10) << "hits"
+              << std::setw(8) << "threads" << std::setw(11) << "prepare" << std::setw(11) << "density"
+              << std::setw(11) << "delta" << std::setw(11) << "seeds" << std::setw(11) << "assign"
+              << std::setw(11) << "total" << std::setw(11) << "clear" << std::setw(11) << "evt/s"
+              << std::setw(12) << "Mhits/s" << std::setw(11) << "peak MB" << "\n";
+    std::cout << std::left << std::setw(33) << "" << std::right << std::setw(77) << "(mean time per event [ms])" << "\n";
+  }
+
+  void printResult(bool csv, const std::string& geometry, std::size_t hits, unsigned threads, const Result& res) {
+    const double n = res.runs;
+    const double evtPerSec = res.runs / (res.wallTime / 1000.);
+    const double values[] = {res.timings.prepareDataStructures / n,
+                             res.timings.calculateLocalDensity / n,
+                             res.timings.calculateDistanceToHigher / n,
+                             res.timings.findSeedAndFollowers / n,
+                             res.timings.assignClusters / n,
+                             res.timings.total / n,
+                             res.clearLayerTiles / n};
+    if (csv) {
+      std::cout << geometry << "," << hits << "," << threads;
+      for (auto v : values)
+        std::cout << "," << v;
+      std::cout << "," << evtPerSec << "," << evtPerSec * hits << "," << res.peakRSS << "\n";
+      return;
+    }
+    std::cout << std::left << std::setw(15) << geometry << std::right << std::setw(10) << hits << std::setw(8)
+              << threads << std::fixed << std::setprecision(3);
+    for (auto v : values)
+      std::cout << std::setw(11) << v;
+    std::cout << std::setprecision(1) << std::setw(11) << evtPerSec << std::setprecision(3) << std::setw(12)
+              << evtPerSec * hits * 1e-6 << std::setprecision(1) << std::setw(11) << res.peakRSS << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--geometry")
+      opt.geometries.push_back(next());
+    else if (arg == "--hits")
+      opt.hits = parseList<std::size_t>(next());
+    else if (arg == "--threads")
+      opt.threads = parseList<unsigned>(next());
+    else if (arg == "--events")
+      opt.events = std::stoul(next());
+    else if (arg == "--dc")
+      opt.dc = std::stof(next());
+    else if (arg == "--rhoc")
+      opt.rhoc = std::stof(next());
+    else if (arg == "--outlierDeltaFactor")
+      opt.outlierDeltaFactor = std::stof(next());
+    else if (arg == "--seed")
+      opt.seed = std::stoull(next());
+    else if (arg == "--csv")
+      opt.csv = true;
+    else if (arg == "--trace")
+      opt.traceFile = next();
+    else if (arg == "--backend")
+      opt.backend = next();
+    else if (arg == "--scanDc")
+      opt.scanDc = parseList<float>(next());
+    else if (arg == "--neighbourCache")
+      opt.neighbourCacheMB = std::stoul(next());
+    else if (arg == "--capSeedDelta")
+      opt.capSeedDelta = true;
+    else if (arg == "--deltaEngine") {
+      const std::string name = next();
+      if (!clue::deltaEngineFromName(name, opt.deltaEngine)) {
+        std::cerr << "Unknown delta engine " << name << std::endl;
+        return 1;
+      }
+    } else if (arg == "--energyThreshold")
+      opt.energyThreshold = std::stof(next());
+    else {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  const auto backends = clue::clueBackendNames();
+  if (!opt.backend.empty() && std::find(backends.begin(), backends.end(), opt.backend) == backends.end()) {
+    std::cerr << "Unknown backend " << opt.backend << std::endl;
+    return 1;
+  }
+  // CLUEAlgoParallel_T only implements the default search
+  if (!opt.backend.empty() && opt.neighbourCacheMB > 0) {
+    std::cerr << "--neighbourCache is not supported with --backend" << std::endl;
+    return 1;
+  }
+  if (!opt.backend.empty() && opt.capSeedDelta) {
+    std::cerr << "--capSeedDelta is not supported with --backend" << std::endl;
+    return 1;
+  }
+  if (!opt.backend.empty() && opt.deltaEngine != CLUEDeltaEngine::Tiles) {
+    std::cerr << "--deltaEngine must be Tiles with --backend" << std::endl;
+    return 1;
+  }
+  if (opt.threads.empty()) {
+    const unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 1; t < maxThreads; t *= 2)
+      opt.threads.push_back(t);
+    opt.threads.push_back(maxThreads);
+  }
+  if (opt.geometries.empty())
+    clue::forEachCLUEAlgo([&](auto, const char* name) { opt.geometries.push_back(name); });
+
+  if (!opt.traceFile.empty())
+    clue::Tracer::instance().enable();
+
+  if (opt.scanDc.empty()) {
+    printHeader(opt.csv);
+  } else if (opt.csv) {
+    std::cout << "geometry,hits,dcs,independent_ms,scan_ms,speedup,same_clusters\n";
+  } else {
+    std::cout << std::left << std::setw(15) << "geometry" << std::right << std::setw(10) << "hits" << std::setw(8)
+              << "dcs" << std::setw(16) << "independent" << std::setw(11) << "scan" << std::setw(10) << "speedup"
+              << std::setw(8) << "same" << "\n";
+    std::cout << std::left << std::setw(33) << "" << std::right << std::setw(27) << "(mean time per event [ms])" << "\n";
+  }
+  for (const auto& geometry : opt.geometries) {
+    bool found = clue::dispatchCLUEAlgo(geometry, [&](auto tag) {
+      using ALGO = typename decltype(tag)::type;
+      using Constants = typename ALGO::constants_type_t;
+      for (auto hits : opt.hits) {
+        std::vector<clue::InputPoints> inputs(std::min(opt.events, 3u));
+        for (std::size_t e = 0; e < inputs.size(); ++e) {
+          clue::GeneratorConfig cfg;
+          cfg.nHits = hits;
+          cfg.seed = opt.seed + e;
+          clue::generateEvent<Constants>(cfg, inputs[e]);
+        }
+        if (!opt.scanDc.empty()) {
+          runScanDc<ALGO>(opt, inputs, geometry, hits);
+          continue;
+        }
+        for (auto threads : opt.threads) {
+          resetPeakRSS();
+          auto res = runBackend<ALGO>(opt, inputs, threads);
+          printResult(opt.csv, geometry, hits, threads, res);
+        }
+      }
+    });
+    if (!found)
+      std::cerr << "Unknown geometry " << geometry << std::endl;
+  }
+
+  if (!opt.traceFile.empty() && !clue::Tracer::instance().dump(opt.traceFile)) {
+    std::cerr << "ERROR: could not write the trace file " << opt.traceFile << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Writes a synthetic event (see EventGenerator.h) to a csv file with the
+// columns x,y,layer,weight(,r): the r column is only written for barrel
+// geometries, where it is needed to compute phi = x/r.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "CLUEAlgoRegistry.h"
+#include "EventGenerator.h"
+
+int main(int argc, char* argv[]) {
+  std::string geometry = "Default";
+  std::string outputFileName;
+  clue::GeneratorConfig cfg;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Usage: " << argv[0] << " --output FILE [--geometry NAME] [--hits N] [--seed S]"
+                << " [--noiseFraction F] [--hitsPerShower N] [--lateralSpread MM]" << std::endl;
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--geometry")
+      geometry = value;
+    else if (arg == "--output")
+      outputFileName = value;
+    else if (arg == "--hits")
+      cfg.nHits = std::stod(value);
+    else if (arg == "--seed")
+      cfg.seed = std::stoull(value);
+    else if (arg == "--noiseFraction")
+      cfg.noiseFraction = std::stof(value);
+    else if (arg == "--hitsPerShower")
+      cfg.hitsPerShower = std::stoi(value);
+    else if (arg == "--lateralSpread")
+      cfg.lateralSpread = std::stof(value);
+    else {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return 1;
+    }
+  }
+  if (outputFileName.empty()) {
+    std::cerr << "ERROR: no output file given (--output)" << std::endl;
+    return 1;
+  }
+
+  clue::InputPoints points;
+  bool isBarrel = false;
+  bool found = clue::dispatchCLUEAlgo(geometry, [&](auto tag) {
+    using Constants = typename decltype(tag)::type::constants_type_t;
+    isBarrel = !Constants::endcap;
+    clue::generateEvent<Constants>(cfg, points);
+  });
+  if (!found) {
+    std::cerr << "ERROR: unknown geometry " << geometry << std::endl;
+    return 1;
+  }
+
+  std::ofstream oFile(outputFileName);
+  if (!oFile.is_open()) {
+    std::cerr << "ERROR: Failed to open the file " << outputFileName << std::endl;
+    return 1;
+  }
+  oFile.precision(7);
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    oFile << points.x[i] << ',' << points.y[i] << ',' << points.layer[i] << ',' << points.weight[i];
+    if (isBarrel)
+      oFile << ',' << points.r[i];
+    oFile << '\n';
+  }
+  std::cout << "Written " << points.size() << " hits (" << geometry << ") to " << outputFileName << std::endl;
+
+  return 0;
+}
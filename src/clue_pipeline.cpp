@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Multi-threaded streaming CLUE reconstruction of EDM4hep files, without
+// Gaudi: the same clusters as ClueGaudiAlgorithmWrapper, for throughput
+// studies and for running CLUE where the framework is not available.
+//
+// One reader thread reads the events and decodes the CLUE inputs of the
+// calorimeter hits, a pool of workers clusters them, each one with its own
+// CLUE algos and event arenas, and one writer thread writes the events in
+// their input order. The stages are connected by bounded lock-free queues
+// (BoundedQueue.h), whose depth is reported at the end with the sustained
+// event rate: a full input queue means that the workers are the bottleneck,
+// an empty one that the reader is.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <edm4hep/CalorimeterHitCollection.h>
+#include <edm4hep/ClusterCollection.h>
+
+#include <podio/Frame.h>
+#include <podio/ROOTReader.h>
+#include <podio/ROOTWriter.h>
+
+#include "BoundedQueue.h"
+#include "CLUEAlgoRegistry.h"
+#include "CLUEClusterBuilder.h"
+#include "CellIDDecoder.h"
+#include "EventArena.h"
+
+namespace {
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Options {
+    std::string input;
+    std::string output;
+    std::vector<std::string> collections{"ECALBarrel", "ECALEndcap"};
+    std::vector<std::string> geometries{"CLICdetBarrel", "CLICdetEndcap"};
+    float dc = 15.f;
+    float rhoc = 0.02f;
+    float outlierDeltaFactor = 3.f;
+    float timeWindow = 0.f;
+    float thresholdW0 = 2.9f;
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t queueCapacity = 0;  // default: 2 x workers
+    std::size_t maxEvents = 0;
+  };
+
+  std::vector<std::string> parseList(const std::string& s) {
+    std::vector<std::string> values;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      values.push_back(item);
+    return values;
+  }
+
+  void usage(const char* name) {
+    std::cout << "Usage: " << name << " INPUT [options]\n"
+              << "  --output FILE            write the events with the CLUE clusters to FILE\n"
+              << "  --collections C1,C2,...  calorimeter hit collections to cluster (default: ECALBarrel,ECALEndcap)\n"
+              << "  --geometries G1,G2,...   CLUE geometry of each collection (default: CLICdetBarrel,CLICdetEndcap)\n"
+              << "  --dc, --rhoc, --outlierDeltaFactor  CLUE parameters (default: 15, 0.02, 3)\n"
+              << "  --timeWindow T           CLUE time window, 0 to ignore the time of the hits (default: 0)\n"
+              << "  --thresholdW0 W          log-weight threshold of the cluster positions (default: 2.9)\n"
+              << "  --workers N              number of clustering threads (default: number of cores)\n"
+              << "  --queue N                capacity of the queues (default: 2 x workers)\n"
+              << "  --events N               process at most N events\n";
+  }
+
+  // CLUE inputs of one collection, see ClueGaudiAlgorithmWrapper::fillCLUEPoints
+  struct Inputs {
+    const edm4hep::CalorimeterHitCollection* hits = nullptr;
+    std::vector<float> x, y, r, weight, time;
+    std::vector<int> layer;
+  };
+
+  struct Event {
+    std::size_t index;
+    podio::Frame frame;
+    std::vector<Inputs> inputs;
+    std::size_t nClusters = 0;
+    int nZeroEnergy = 0;
+  };
+
+  using EventPtr = std::unique_ptr<Event>;
+
+  struct DepthStats {
+    double sum = 0.;
+    std::size_t samples = 0;
+    std::size_t max = 0;
+
+    void sample(std::size_t depth) {
+      sum += depth;
+      ++samples;
+      max = std::max(max, depth);
+    }
+    double mean() const { return samples ? sum / samples : 0.; }
+  };
+
+  // first error of any stage, which stops the pipeline
+  class ErrorState {
+  public:
+    void set(const std::string& message) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (message_.empty())
+        message_ = message;
+      failed_.store(true, std::memory_order_relaxed);
+    }
+    bool failed() const { return failed_.load(std::memory_order_relaxed); }
+    const std::string& message() const { return message_; }
+
+  private:
+    std::mutex mutex_;
+    std::string message_;
+    std::atomic<bool> failed_{false};
+  };
+
+  std::optional<std::string> cellIDEncoding(const podio::Frame& frame, const std::string& collection) {
+    return frame.getParameter<std::string>(collection + "__CellIDEncoding");
+  }
+
+  // Reads the events and decodes the CLUE inputs of their hits
+  class Reader {
+  public:
+    Reader(const Options& opt, const std::vector<std::unique_ptr<clue::CLUEAlgoBase>>& layouts,
+           std::optional<podio::Frame>& metadata, podio::ROOTReader& reader)
+        : opt_(opt), reader_(reader), metadata_(metadata) {
+      for (const auto& algo : layouts)
+        layouts_.push_back({algo->endcap(), algo->nLayers()});
+      decoders_.resize(opt.collections.size());
+    }
+
+    void run(std::size_t nEvents, clue::BoundedQueue<EventPtr>& out, ErrorState& error) {
+      for (std::size_t i = 0; i < nEvents && !error.failed(); ++i) {
+        auto start = Clock::now();
+        auto event = std::make_unique<Event>(Event{i, podio::Frame(reader_.readNextEntry("events")), {}});
+        event->inputs.resize(opt_.collections.size());
+        for (std::size_t c = 0; c < opt_.collections.size(); ++c) {
+          if (!decode(*event, c, error))
+            break;
+        }
+        busy_ += Clock::now() - start;
+        depth_.sample(out.sizeApprox());
+        out.push(std::move(event));
+      }
+      out.close();
+    }
+
+    double busy() const { return std::chrono::duration<double>(busy_).count(); }
+    const DepthStats& depth() const { return depth_; }
+
+  private:
+    struct Layout {
+      bool endcap;
+      int nLayers;
+    };
+
+    struct Decoder {
+      std::string encoding;
+      std::optional<clue::CellIDDecoder> decoder;
+      int layer = -1;
+      int side = -1;
+    };
+
+    const Decoder* decoder(const podio::Frame& frame, std::size_t c, ErrorState& error) {
+      const auto& collection = opt_.collections[c];
+      auto encoding = cellIDEncoding(frame, collection);
+      if (!encoding && metadata_)
+        encoding = cellIDEncoding(*metadata_, collection);
+      if (!encoding) {
+        error.set("No cellID encoding for " + collection);
+        return nullptr;
+      }
+
+      auto& d = decoders_[c];
+      if (d.decoder && d.encoding == *encoding)
+        return &d;
+      try {
+        d.decoder.emplace(*encoding);
+      } catch (const std::exception& e) {
+        error.set(e.what());
+        return nullptr;
+      }
+      d.encoding = *encoding;
+      d.layer = d.decoder->index("layer");
+      d.side = d.decoder->index("side");
+      if (d.layer < 0 || (layouts_[c].endcap && d.side < 0)) {
+        error.set("Missing layer or side field in the cellID encoding of " + collection);
+        return nullptr;
+      }
+      return &d;
+    }
+
+    bool decode(Event& event, std::size_t c, ErrorState& error) {
+      const auto& collection = opt_.collections[c];
+      auto& in = event.inputs[c];
+      in.hits = dynamic_cast<const edm4hep::CalorimeterHitCollection*>(event.frame.get(collection));
+      if (in.hits == nullptr) {
+        error.set("Collection " + collection + " not found in event " + std::to_string(event.index));
+        return false;
+      }
+      if (in.hits->empty())
+        return true;
+      const Decoder* d = decoder(event.frame, c, error);
+      if (d == nullptr)
+        return false;
+
+      const auto n = in.hits->size();
+      in.x.reserve(n);
+      in.y.reserve(n);
+      in.r.reserve(n);
+      in.layer.reserve(n);
+      in.weight.reserve(n);
+      in.time.reserve(n);
+      // The layers of the endcap geometries include both sides
+      const int maxLayerPerSide = layouts_[c].nLayers / 2;
+      for (const auto& hit : *in.hits) {
+        const auto& pos = hit.getPosition();
+        const float r = std::sqrt(pos.x * pos.x + pos.y * pos.y);
+        int layer = d->decoder->get(hit.getCellID(), d->layer);
+        if (layouts_[c].endcap) {
+          auto side = d->decoder->get(hit.getCellID(), d->side);
+          if (side >= 0 && side <= 1)
+            layer += maxLayerPerSide;
+          in.x.push_back(pos.x);
+          in.y.push_back(pos.y);
+        } else {
+          in.x.push_back(std::atan2(pos.y, pos.x) * r);
+          in.y.push_back(pos.z);
+        }
+        in.r.push_back(r);
+        in.layer.push_back(layer);
+        in.weight.push_back(hit.getEnergy());
+        in.time.push_back(hit.getTime());
+      }
+      return true;
+    }
+
+    const Options& opt_;
+    podio::ROOTReader& reader_;
+    const std::optional<podio::Frame>& metadata_;
+    std::vector<Layout> layouts_;
+    std::vector<Decoder> decoders_;
+    Clock::duration busy_{};
+    DepthStats depth_;
+  };
+
+  // Clusters the events, with its own CLUE algos and memory
+  class Worker {
+  public:
+    explicit Worker(const Options& opt) : thresholdW0_(opt.thresholdW0) {
+      for (std::size_t c = 0; c < opt.collections.size(); ++c) {
+        algos_.push_back(clue::makeCLUEAlgo(opt.geometries[c], opt.dc, opt.rhoc, opt.outlierDeltaFactor));
+        algos_.back()->setTimeWindow(opt.timeWindow);
+        arenas_.push_back(std::make_unique<clue::EventArena>());
+      }
+    }
+
+    void run(clue::BoundedQueue<EventPtr>& in, clue::BoundedQueue<EventPtr>& out, ErrorState& error) {
+      EventPtr event;
+      while (in.pop(event)) {
+        if (error.failed())
+          continue;
+        auto start = Clock::now();
+        process(*event, error);
+        busy_ += Clock::now() - start;
+        out.push(std::move(event));
+      }
+    }
+
+    double busy() const { return std::chrono::duration<double>(busy_).count(); }
+
+  private:
+    void process(Event& event, ErrorState& error) {
+      edm4hep::ClusterCollection clusters;
+      for (std::size_t c = 0; c < algos_.size(); ++c) {
+        auto& algo = *algos_[c];
+        auto& arena = *arenas_[c];
+        algo.setMemoryResource(std::pmr::null_memory_resource());
+        arena.reset();
+        algo.setMemoryResource(arena.resource());
+
+        const auto& in = event.inputs[c];
+        if (in.x.empty())
+          continue;
+        if (algo.clearAndSetPoints(in.x.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(),
+                                   in.r.data(), in.time.data())) {
+          error.set("Error in setting the clue points of event " + std::to_string(event.index));
+          return;
+        }
+        algo.makeClusters();
+        const auto clueClusters = algo.getClusters();
+        algo.clearLayerTiles();
+        event.nZeroEnergy += clue::fillFinalClusters(*in.hits, in.layer, clueClusters, clusters, thresholdW0_,
+                                                   arena.resource());
+      }
+
+      edm4hep::CalorimeterHitCollection caloHits;
+      clue::transformClustersInCaloHits(clusters, caloHits);
+      event.nClusters = clusters.size();
+      event.frame.put(std::move(clusters), "CLUEClusters");
+      event.frame.put(std::move(caloHits), "CLUEClustersAsHits");
+    }
+
+    float thresholdW0_;
+    // per-event memory of the algos, declared before them so that they are destroyed first
+    std::vector<std::unique_ptr<clue::EventArena>> arenas_;
+    std::vector<std::unique_ptr<clue::CLUEAlgoBase>> algos_;
+    Clock::duration busy_{};
+  };
+
+  // Writes the events in their input order
+  class Writer {
+  public:
+    explicit Writer(const std::string& output) {
+      if (!output.empty())
+        writer_ = std::make_unique<podio::ROOTWriter>(output);
+    }
+
+    void run(clue::BoundedQueue<EventPtr>& in) {
+      EventPtr event;
+      std::map<std::size_t, EventPtr> pending;
+      std::size_t next = 0;
+      while (in.pop(event)) {
+        depth_.sample(in.sizeApprox());
+        auto start = Clock::now();
+        pending.emplace(event->index, std::move(event));
+        maxPending_ = std::max(maxPending_, pending.size());
+        for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it), ++next)
+          write(*it->second);
+        busy_ += Clock::now() - start;
+      }
+      // only left if a stage failed
+      for (auto& [index, e] : pending)
+        write(*e);
+    }
+
+    void finish(const std::optional<podio::Frame>& metadata) {
+      if (!writer_)
+        return;
+      if (metadata)
+        writer_->writeFrame(*metadata, "metadata");
+      writer_->finish();
+    }
+
+    double busy() const { return std::chrono::duration<double>(busy_).count(); }
+    const DepthStats& depth() const { return depth_; }
+    std::size_t maxPending() const { return maxPending_; }
+    std::size_t events() const { return events_; }
+    std::size_t clusters() const { return clusters_; }
+    std::size_t zeroEnergy() const { return zeroEnergy_; }
+
+  private:
+    void write(const Event& event) {
+      ++events_;
+      clusters_ += event.nClusters;
+      zeroEnergy_ += event.nZeroEnergy;
+      if (writer_)
+        writer_->writeFrame(event.frame, "events");
+    }
+
+    std::unique_ptr<podio::ROOTWriter> writer_;
+    Clock::duration busy_{};
+    DepthStats depth_;
+    std::size_t maxPending_ = 0;
+    std::size_t events_ = 0;
+    std::size_t clusters_ = 0;
+    std::size_t zeroEnergy_ = 0;
+  };
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--output")
+      opt.output = next();
+    else if (arg == "--collections")
+      opt.collections = parseList(next());
+    else if (arg == "--geometries")
+      opt.geometries = parseList(next());
+    else if (arg == "--dc")
+      opt.dc = std::stof(next());
+    else if (arg == "--rhoc")
+      opt.rhoc = std::stof(next());
+    else if (arg == "--outlierDeltaFactor")
+      opt.outlierDeltaFactor = std::stof(next());
+    else if (arg == "--timeWindow")
+      opt.timeWindow = std::stof(next());
+    else if (arg == "--thresholdW0")
+      opt.thresholdW0 = std::stof(next());
+    else if (arg == "--workers")
+      opt.workers = std::max(1ul, std::stoul(next()));
+    else if (arg == "--queue")
+      opt.queueCapacity = std::stoul(next());
+    else if (arg == "--events")
+      opt.maxEvents = std::stoul(next());
+    else if (opt.input.empty() && arg[0] != '-')
+      opt.input = arg;
+    else {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (opt.input.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (opt.collections.size() != opt.geometries.size()) {
+    std::cerr << "--collections and --geometries must have the same length" << std::endl;
+    return 1;
+  }
+  if (opt.queueCapacity == 0)
+    opt.queueCapacity = 2 * opt.workers;
+
+  // one algo per collection to check the geometries before starting
+  std::vector<std::unique_ptr<clue::CLUEAlgoBase>> layouts;
+  for (const auto& geometry : opt.geometries) {
+    layouts.push_back(clue::makeCLUEAlgo(geometry, opt.dc, opt.rhoc, opt.outlierDeltaFactor));
+    if (!layouts.back()) {
+      std::cerr << "Unknown geometry " << geometry << std::endl;
+      return 1;
+    }
+  }
+
+  podio::ROOTReader rootReader;
+  rootReader.openFile(opt.input);
+  std::optional<podio::Frame> metadata;
+  if (rootReader.getEntries("metadata") > 0)
+    metadata.emplace(rootReader.readEntry("metadata", 0));
+  std::size_t nEvents = rootReader.getEntries("events");
+  if (opt.maxEvents > 0)
+    nEvents = std::min(nEvents, opt.maxEvents);
+
+  clue::BoundedQueue<EventPtr> toWorkers(opt.queueCapacity);
+  clue::BoundedQueue<EventPtr> toWriter(opt.queueCapacity);
+  ErrorState error;
+
+  Reader reader(opt, layouts, metadata, rootReader);
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (unsigned w = 0; w < opt.workers; ++w)
+    workers.push_back(std::make_unique<Worker>(opt));
+  Writer writer(opt.output);
+
+  auto start = Clock::now();
+  {
+    std::jthread writerThread([&] { writer.run(toWriter); });
+    {
+      std::vector<std::jthread> workerThreads;
+      for (auto& worker : workers)
+        workerThreads.emplace_back([&, w = worker.get()] { w->run(toWorkers, toWriter, error); });
+      std::jthread readerThread([&] { reader.run(nEvents, toWorkers, error); });
+    }
+    toWriter.close();
+  }
+  std::chrono::duration<double> wall = Clock::now() - start;
+  writer.finish(metadata);
+
+  if (error.failed()) {
+    std::cerr << "ERROR: " << error.message() << std::endl;
+    return 1;
+  }
+
+  double workerBusy = 0.;
+  for (const auto& worker : workers)
+    workerBusy += worker->busy();
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << writer.events() << " events, " << writer.clusters() << " clusters, " << opt.workers << " workers\n"
+            << "wall time           " << wall.count() << " s\n"
+            << "throughput          " << writer.events() / wall.count() << " events/s\n"
+            << "reader busy         " << 100. * reader.busy() / wall.count() << " %\n"
+            << "workers busy        " << 100. * workerBusy / (wall.count() * opt.workers) << " %\n"
+            << "writer busy         " << 100. * writer.busy() / wall.count() << " %\n"
+            << "input queue depth   mean " << reader.depth().mean() << ", max " << reader.depth().max << " / "
+            << toWorkers.capacity() << "\n"
+            << "output queue depth  mean " << writer.depth().mean() << ", max " << writer.depth().max << " / "
+            << toWriter.capacity() << "\n"
+            << "reorder buffer      max " << writer.maxPending() << " events\n";
+  if (writer.zeroEnergy() > 0)
+    std::cout << "WARNING: " << writer.zeroEnergy() << " clusters without energy\n";
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Python bindings of the CLUEAlgo_T instantiations of CLUEAlgoRegistry.h,
+// e.g. CLICdetEndcapCLUEAlgo, built with -DK4CLUE_PYTHON=ON:
+//
+//   import numpy as np, pyclue
+//   algo = pyclue.CLICdetEndcapCLUEAlgo(dc=15., rhoc=0.02, outlierDeltaFactor=3.)
+//   algo.setPoints(x, y, layer, weight)   # float32 / int32 contiguous arrays
+//   algo.makeClusters()                    # releases the GIL
+//   labels = algo.clusterIndex             # view of the algo buffer
+//
+// The inputs are read in place, without conversion or copy: arrays of
+// another dtype or not contiguous are rejected, and the algo keeps a
+// reference to them until its next setPoints(), so they must not be
+// modified in between. The results are views of the buffers of the algo,
+// valid until its next setPoints(); copy them to keep them longer. Each
+// algo may be used by one Python thread at a time, several algos run
+// concurrently.
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "CLUEAlgoRegistry.h"
+
+namespace py = pybind11;
+
+namespace {
+
+  template <typename T>
+  using InputArray = py::array_t<T, py::array::c_style>;
+
+  template <typename T>
+  const T* checkedData(const InputArray<T>& a, py::ssize_t n, const char* name) {
+    if (a.ndim() != 1 || a.shape(0) != n)
+      throw std::invalid_argument(std::string(name) + " must be a 1D array with the length of x");
+    return a.data();
+  }
+
+  // view of a column of the points, which keeps the algo alive
+  template <typename ALGO, typename T>
+  auto pointsColumn(std::pmr::vector<T> Points::*column) {
+    return [column](py::object self) {
+      const auto& values = self.cast<const ALGO&>().getPoints().*column;
+      return py::array_t<T>({static_cast<py::ssize_t>(values.size())}, {static_cast<py::ssize_t>(sizeof(T))},
+                            values.data(), self);
+    };
+  }
+
+  template <typename ALGO>
+  void bindCLUEAlgo(py::module_& m, const std::string& name) {
+    // the instance dict holds the input arrays, see setPoints
+    py::class_<ALGO>(m, name.c_str(), py::dynamic_attr())
+        .def(py::init<float, float, float, bool>(), py::arg("dc"), py::arg("rhoc"), py::arg("outlierDeltaFactor"),
+             py::arg("verbose") = false)
+        .def_readwrite("dc", &ALGO::dc_)
+        .def_readwrite("rhoc", &ALGO::rhoc_)
+        .def_readwrite("outlierDeltaFactor", &ALGO::outlierDeltaFactor_)
+        .def_readwrite("timeWindow", &ALGO::timeWindow_)
+        .def(
+            "setPoints",
+            [](py::object self, const InputArray<float>& x, const InputArray<float>& y, const InputArray<int>& layer,
+               const InputArray<float>& weight, std::optional<InputArray<float>> r,
+               std::optional<InputArray<float>> time) {
+              auto& algo = self.cast<ALGO&>();
+              const py::ssize_t n = x.ndim() == 1 ? x.shape(0) : -1;
+              const float* xData = checkedData(x, n, "x");
+              const float* yData = checkedData(y, n, "y");
+              const int* layerData = checkedData(layer, n, "layer");
+              const float* weightData = checkedData(weight, n, "weight");
+              const float* rData = r ? checkedData(*r, n, "r") : nullptr;
+              const float* timeData = time ? checkedData(*time, n, "time") : nullptr;
+              // CLUE reads the arrays in place, they live as long as its points
+              py::setattr(self, "_inputs",
+                          py::make_tuple(x, y, layer, weight, r ? py::object(*r) : py::none(),
+                                         time ? py::object(*time) : py::none()));
+              bool failed;
+              {
+                py::gil_scoped_release release;
+                failed = algo.clearAndSetPoints(static_cast<int>(n), xData, yData, layerData, weightData, rData, timeData);
+              }
+              if (failed)
+                throw std::invalid_argument(
+                    "invalid points: empty, or missing r (barrel geometries) or time (time window set)");
+            },
+            py::arg("x").noconvert(), py::arg("y").noconvert(), py::arg("layer").noconvert(),
+            py::arg("weight").noconvert(), py::arg("r").noconvert() = py::none(),
+            py::arg("time").noconvert() = py::none())
+        .def("makeClusters", &ALGO::makeClusters, py::call_guard<py::gil_scoped_release>())
+        .def("clearLayerTiles", &ALGO::clearLayerTiles, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("rho", pointsColumn<ALGO>(&Points::rho))
+        .def_property_readonly("delta", pointsColumn<ALGO>(&Points::delta))
+        .def_property_readonly("nearestHigher", pointsColumn<ALGO>(&Points::nearestHigher))
+        .def_property_readonly("clusterIndex", pointsColumn<ALGO>(&Points::clusterIndex))
+        .def_property_readonly("isSeed", pointsColumn<ALGO>(&Points::isSeed))
+        .def_property_readonly("endcap", [](const ALGO&) { return ALGO::constants_type_t::endcap; })
+        .def_property_readonly("nLayers", [](const ALGO&) { return ALGO::constants_type_t::nLayers; });
+  }
+
+} // namespace
+
+PYBIND11_MODULE(pyclue, m) {
+  m.doc() = "CLUE clustering algorithm, one class per detector geometry";
+  clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+    using ALGO = typename decltype(tag)::type;
+    const std::string geometry = name;
+    bindCLUEAlgo<ALGO>(m, geometry == "Default" ? "CLUEAlgo" : geometry + "CLUEAlgo");
+  });
+}
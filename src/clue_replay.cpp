@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Replay of the CLUE inputs captured by ClueGaudiAlgorithmWrapper (property
+// CaptureFile) without the framework: every record of the capture file is
+// clustered again with the CLUEAlgo_T of its geometry, to profile or debug
+// CLUE on the exact inputs of a production job.
+// With --scanRhoc and/or --scanOutlierDeltaFactor, every record is instead
+// clustered for the whole grid of values with CLUEAlgo_T::scanClusters().
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CLUEAlgoRegistry.h"
+#include "CLUEEventFile.h"
+
+namespace {
+
+  struct Options {
+    std::string fileName;
+    std::string region;
+    std::string geometry;
+    float dc = -1.f;
+    float rhoc = -1.f;
+    float outlierDeltaFactor = -1.f;
+    unsigned repeat = 1;
+    bool csv = false;
+    std::string traceFile;
+    std::vector<float> scanRhoc;
+    std::vector<float> scanOutlierDeltaFactor;
+  };
+
+  std::vector<float> parseList(const std::string& s) {
+    std::vector<float> values;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      values.push_back(std::stof(item));
+    return values;
+  }
+
+  void usage(const char* name) {
+    std::cout << "Usage: " << name << " FILE [options]\n"
+              << "  --region NAME       replay only the records of this region\n"
+              << "  --geometry NAME     override the geometry of the records\n"
+              << "  --dc, --rhoc, --outlierDeltaFactor  override the CLUE parameters of the records\n"
+              << "  --repeat N          cluster every record N times (default: 1)\n"
+              << "  --csv               print the results as csv\n"
+              << "  --trace FILE        record the CLUE phases in a Chrome trace JSON file\n"
+              << "  --scanRhoc R1,R2,...                scan these rhoc values (default: the one of the records)\n"
+              << "  --scanOutlierDeltaFactor O1,O2,...  scan these outlierDeltaFactor values (default: the one of the records)\n";
+  }
+
+  // one instance per geometry, the tiles are built once
+  template <typename ALGO>
+  ALGO& algoFor(float dc, float rhoc, float outlierDeltaFactor) {
+    static ALGO algo(dc, rhoc, outlierDeltaFactor, false);
+    algo.dc_ = dc;
+    algo.rhoc_ = rhoc;
+    algo.outlierDeltaFactor_ = outlierDeltaFactor;
+    return algo;
+  }
+
+  struct Result {
+    CLUETimings timings;
+    double clearLayerTiles = 0.;
+    long nClusters = 0;
+  };
+
+  template <typename ALGO>
+  Result replay(const Options& opt, const clue::CapturedRegion& rec, float dc, float rhoc, float outlierDeltaFactor) {
+    auto& algo = algoFor<ALGO>(dc, rhoc, outlierDeltaFactor);
+    algo.setTraceRegion(std::string(rec.region) + " " + std::to_string(rec.event));
+    Result res;
+    for (unsigned i = 0; i < opt.repeat; ++i) {
+      if (algo.clearAndSetPoints(rec.n, rec.x, rec.y, rec.layer, rec.weight, rec.r)) {
+        std::cerr << "ERROR: invalid points in event " << rec.event << " (" << rec.region << ")" << std::endl;
+        std::exit(1);
+      }
+      algo.makeClusters();
+      res.nClusters = std::count(algo.points_.isSeed.begin(), algo.points_.isSeed.end(), 1);
+      auto start = std::chrono::high_resolution_clock::now();
+      algo.clearLayerTiles();
+      std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+      const auto& tm = algo.getTimings();
+      res.timings.prepareDataStructures += tm.prepareDataStructures / opt.repeat;
+      res.timings.calculateLocalDensity += tm.calculateLocalDensity / opt.repeat;
+      res.timings.calculateDistanceToHigher += tm.calculateDistanceToHigher / opt.repeat;
+      res.timings.findSeedAndFollowers += tm.findSeedAndFollowers / opt.repeat;
+      res.timings.assignClusters += tm.assignClusters / opt.repeat;
+      res.timings.total += tm.total / opt.repeat;
+      res.clearLayerTiles += elapsed.count() * 1000 / opt.repeat;
+    }
+    return res;
+  }
+
+  // clusters of every (rhoc, outlierDeltaFactor) of the grid, from a single density pass
+  template <typename ALGO>
+  void scan(const Options& opt, const clue::CapturedRegion& rec, const std::string& geometry, float dc, float rhoc,
+            float outlierDeltaFactor) {
+    auto& algo = algoFor<ALGO>(dc, rhoc, outlierDeltaFactor);
+    algo.setTraceRegion(std::string(rec.region) + " " + std::to_string(rec.event));
+    if (algo.clearAndSetPoints(rec.n, rec.x, rec.y, rec.layer, rec.weight, rec.r)) {
+      std::cerr << "ERROR: invalid points in event " << rec.event << " (" << rec.region << ")" << std::endl;
+      std::exit(1);
+    }
+
+    const auto rhocs = opt.scanRhoc.empty() ? std::vector<float>{rhoc} : opt.scanRhoc;
+    const auto factors = opt.scanOutlierDeltaFactor.empty() ? std::vector<float>{outlierDeltaFactor}
+                                                            : opt.scanOutlierDeltaFactor;
+    std::vector<std::pair<float, float>> settings;
+    for (auto r : rhocs)
+      for (auto o : factors)
+        settings.emplace_back(r, o);
+
+    const auto results = algo.scanClusters(settings);
+    algo.clearLayerTiles();
+    for (const auto& res : results) {
+      std::cout << rec.event << "," << rec.region << "," << geometry << "," << rec.n << "," << dc << "," << res.rhoc
+                << "," << res.outlierDeltaFactor << "," << res.nSeeds << "," << res.nOutliers << ","
+                << algo.getTimings().total << "\n";
+    }
+  }
+
+  void printHeader(bool csv) {
+    if (csv) {
+      std::cout << "event,region,geometry,hits,clusters,prepare_ms,density_ms,delta_ms,seeds_ms,assign_ms,total_ms,"
+                << "clear_ms\n";
+      return;
+    }
+    std::cout << std::setw(8) << "event" << "  " << std::left << std::setw(10) << "region" << std::setw(15)
+              << "geometry" << std::right << std::setw(10) << "hits" << std::setw(10) << "clusters" << std::setw(11)
+              << "prepare" << std::setw(11) << "density" << std::setw(11) << "delta" << std::setw(11) << "seeds"
+              << std::setw(11) << "assign" << std::setw(11) << "total" << std::setw(11) << "clear" << "\n";
+    std::cout << std::setw(130) << "(mean time per replay [ms])" << "\n";
+  }
+
+  void printResult(bool csv, const clue::CapturedRegion& rec, const std::string& geometry, const Result& res) {
+    const double values[] = {res.timings.prepareDataStructures,
+                             res.timings.calculateLocalDensity,
+                             res.timings.calculateDistanceToHigher,
+                             res.timings.findSeedAndFollowers,
+                             res.timings.assignClusters,
+                             res.timings.total,
+                             res.clearLayerTiles};
+    if (csv) {
+      std::cout << rec.event << "," << rec.region << "," << geometry << "," << rec.n << "," << res.nClusters;
+      for (auto v : values)
+        std::cout << "," << v;
+      std::cout << "\n";
+      return;
+    }
+    std::cout << std::setw(8) << rec.event << "  " << std::left << std::setw(10) << rec.region << std::setw(15)
+              << geometry << std::right << std::setw(10) << rec.n << std::setw(10) << res.nClusters << std::fixed
+              << std::setprecision(3);
+    for (auto v : values)
+      std::cout << std::setw(11) << v;
+    std::cout << "\n";
+    std::cout.unsetf(std::ios::fixed);
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--region")
+      opt.region = next();
+    else if (arg == "--geometry")
+      opt.geometry = next();
+    else if (arg == "--dc")
+      opt.dc = std::stof(next());
+    else if (arg == "--rhoc")
+      opt.rhoc = std::stof(next());
+    else if (arg == "--outlierDeltaFactor")
+      opt.outlierDeltaFactor = std::stof(next());
+    else if (arg == "--repeat")
+      opt.repeat = std::max(1ul, std::stoul(next()));
+    else if (arg == "--csv")
+      opt.csv = true;
+    else if (arg == "--trace")
+      opt.traceFile = next();
+    else if (arg == "--scanRhoc")
+      opt.scanRhoc = parseList(next());
+    else if (arg == "--scanOutlierDeltaFactor")
+      opt.scanOutlierDeltaFactor = parseList(next());
+    else if (opt.fileName.empty() && arg[0] != '-')
+      opt.fileName = arg;
+    else {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (opt.fileName.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  clue::EventFileReader reader;
+  if (!reader.open(opt.fileName))
+    return 1;
+
+  if (!opt.traceFile.empty())
+    clue::Tracer::instance().enable();
+
+  const bool scanning = !opt.scanRhoc.empty() || !opt.scanOutlierDeltaFactor.empty();
+  if (scanning)
+    std::cout << "event,region,geometry,hits,dc,rhoc,outlierDeltaFactor,clusters,outliers,scan_ms\n";
+  else
+    printHeader(opt.csv);
+  for (const auto& rec : reader) {
+    if (!opt.region.empty() && rec.region != opt.region)
+      continue;
+    const std::string geometry = opt.geometry.empty() ? std::string(rec.geometry) : opt.geometry;
+    const float dc = opt.dc < 0.f ? rec.dc : opt.dc;
+    const float rhoc = opt.rhoc < 0.f ? rec.rhoc : opt.rhoc;
+    const float outlierDeltaFactor = opt.outlierDeltaFactor < 0.f ? rec.outlierDeltaFactor : opt.outlierDeltaFactor;
+    bool found = clue::dispatchCLUEAlgo(geometry, [&](auto tag) {
+      using ALGO = typename decltype(tag)::type;
+      if (scanning)
+        scan<ALGO>(opt, rec, geometry, dc, rhoc, outlierDeltaFactor);
+      else
+        printResult(opt.csv, rec, geometry, replay<ALGO>(opt, rec, dc, rhoc, outlierDeltaFactor));
+    });
+    if (!found) {
+      std::cerr << "Unknown geometry " << geometry << std::endl;
+      return 1;
+    }
+  }
+
+  if (!opt.traceFile.empty() && !clue::Tracer::instance().dump(opt.traceFile)) {
+    std::cerr << "ERROR: could not write the trace file " << opt.traceFile << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Standalone CLUE on a csv file (x,y,layer,weight[,r], see CSVReader.h) or on
+// one record of a capture file (see CLUEEventFile.h): the points are
+// clustered with the CLUEAlgo_T of the chosen geometry, a few times to warm
+// up and then --repeat times, and the timing of every phase is reported with
+// printTimingReport. With --reference, the results are compared with a csv
+// written by CLUEAlgo_T::verboseResults (or --output), e.g. data/output.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CLUEAlgoRegistry.h"
+#include "CLUEEventFile.h"
+#include "CSVReader.h"
+#include "TimingStats.h"
+
+namespace {
+
+  struct Options {
+    std::string input;
+    std::string geometry;
+    float dc = -1.f;
+    float rhoc = -1.f;
+    float outlierDeltaFactor = -1.f;
+    std::size_t record = 0;
+    unsigned repeat = 10;
+    unsigned warmup = 1;
+    std::string output;
+    std::string reference;
+    std::vector<std::string> compare{"rho", "delta", "nh", "isSeed", "clusterId"};
+  };
+
+  std::vector<std::string> parseList(const std::string& s) {
+    std::vector<std::string> values;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      values.push_back(item);
+    return values;
+  }
+
+  void usage(const char* name) {
+    std::cout << "Usage: " << name << " INPUT [options]\n"
+              << "  INPUT                  csv file of points, or capture file of ClueGaudiAlgorithmWrapper\n"
+              << "  --geometry NAME        CLUEAlgo_T instantiation (default: Default, or the one of the record)\n"
+              << "  --dc, --rhoc, --outlierDeltaFactor  CLUE parameters (default: 20, 10, 2, or the ones of the record)\n"
+              << "  --record N             record of the capture file to cluster (default: 0)\n"
+              << "  --repeat N             timed runs (default: 10)\n"
+              << "  --warmup N             runs before the timed ones (default: 1)\n"
+              << "  --output FILE          write the results as csv\n"
+              << "  --reference FILE       compare the results with this csv, exit with 1 if they differ\n"
+              << "  --compare C1,C2,...    columns to compare (default: rho,delta,nh,isSeed,clusterId)\n";
+  }
+
+  bool readInput(Options& opt, clue::InputPoints& points) {
+    clue::EventFileReader reader;
+    if (opt.input.size() < 4 || opt.input.compare(opt.input.size() - 4, 4, ".csv") != 0) {
+      if (!reader.open(opt.input))
+        return false;
+      if (opt.record >= reader.size()) {
+        std::cerr << "ERROR: " << opt.input << " has only " << reader.size() << " records" << std::endl;
+        return false;
+      }
+      const auto& rec = reader[opt.record];
+      points.x.assign(rec.x, rec.x + rec.n);
+      points.y.assign(rec.y, rec.y + rec.n);
+      points.r.assign(rec.r, rec.r + rec.n);
+      points.layer.assign(rec.layer, rec.layer + rec.n);
+      points.weight.assign(rec.weight, rec.weight + rec.n);
+      if (opt.geometry.empty())
+        opt.geometry = rec.geometry;
+      opt.dc = opt.dc < 0.f ? rec.dc : opt.dc;
+      opt.rhoc = opt.rhoc < 0.f ? rec.rhoc : opt.rhoc;
+      opt.outlierDeltaFactor = opt.outlierDeltaFactor < 0.f ? rec.outlierDeltaFactor : opt.outlierDeltaFactor;
+      return true;
+    }
+    if (opt.geometry.empty())
+      opt.geometry = "Default";
+    opt.dc = opt.dc < 0.f ? 20.f : opt.dc;
+    opt.rhoc = opt.rhoc < 0.f ? 10.f : opt.rhoc;
+    opt.outlierDeltaFactor = opt.outlierDeltaFactor < 0.f ? 2.f : opt.outlierDeltaFactor;
+    return clue::readCSV(opt.input, points);
+  }
+
+  const std::vector<std::string> columnNames{"x", "y", "layer", "weight", "rho", "delta", "nh", "isSeed", "clusterId"};
+
+  // value of a column of the verboseResults csv, delta is capped at 999 as there
+  template <typename ALGO>
+  double column(const ALGO& algo, const std::string& name, int i) {
+    const auto& p = algo.points_;
+    if (name == "x")
+      return p.x[i];
+    if (name == "y")
+      return p.y[i];
+    if (name == "layer")
+      return p.layer[i];
+    if (name == "weight")
+      return p.weight[i];
+    if (name == "rho")
+      return p.rho[i];
+    if (name == "delta")
+      return std::min(p.delta[i], 999.f);
+    if (name == "nh")
+      return p.nearestHigher[i];
+    if (name == "isSeed")
+      return p.isSeed[i];
+    return p.clusterIndex[i];
+  }
+
+  // number of values of the compared columns which differ from the reference, which is printed with 6 digits
+  template <typename ALGO>
+  int compareWithReference(const ALGO& algo, const Options& opt) {
+    std::ifstream in(opt.reference);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+      std::cerr << "ERROR: could not read the reference " << opt.reference << std::endl;
+      return -1;
+    }
+    const auto header = parseList(line);
+    std::vector<std::size_t> columns;
+    for (const auto& name : opt.compare) {
+      auto it = std::find(header.begin(), header.end(), name);
+      if (it == header.end() || std::find(columnNames.begin(), columnNames.end(), name) == columnNames.end()) {
+        std::cerr << "ERROR: unknown column " << name << std::endl;
+        return -1;
+      }
+      columns.push_back(it - header.begin());
+    }
+
+    int rows = 0;
+    int failures = 0;
+    for (; std::getline(in, line); ++rows) {
+      if (rows >= int(algo.points_.n)) {
+        std::cerr << "  the reference has more than " << algo.points_.n << " points" << std::endl;
+        return failures + 1;
+      }
+      const auto values = parseList(line);
+      for (std::size_t c = 0; c < columns.size(); ++c) {
+        const double expected = std::stod(values.at(columns[c]));
+        const double found = column(algo, opt.compare[c], rows);
+        if (std::abs(found - expected) > 1e-5 * std::max(1., std::abs(expected))) {
+          if (failures < 10)
+            std::cerr << "  " << opt.compare[c] << "[" << rows << "]: expected " << expected << ", found " << found
+                      << std::endl;
+          ++failures;
+        }
+      }
+    }
+    if (rows != int(algo.points_.n)) {
+      std::cerr << "  the reference has " << rows << " points instead of " << algo.points_.n << std::endl;
+      ++failures;
+    }
+    return failures;
+  }
+
+  template <typename ALGO>
+  int run(const Options& opt, const clue::InputPoints& points) {
+    ALGO algo(opt.dc, opt.rhoc, opt.outlierDeltaFactor, false);
+    const char* phases[] = {"prepareDataStructures", "calculateLocalDensity", "calculateDistanceToHigher",
+                            "findSeedAndFollowers", "assignClusters", "total"};
+    std::vector<std::vector<float>> times(std::size(phases));
+    for (unsigned r = 0; r < opt.warmup + opt.repeat; ++r) {
+      if (algo.clearAndSetPoints(points.size(), points.x.data(), points.y.data(), points.layer.data(),
+                                 points.weight.data(), points.r.data())) {
+        std::cerr << "ERROR: invalid points in " << opt.input << std::endl;
+        return 1;
+      }
+      algo.makeClusters();
+      const auto& tm = algo.getTimings();
+      const double values[] = {tm.prepareDataStructures, tm.calculateLocalDensity, tm.calculateDistanceToHigher,
+                               tm.findSeedAndFollowers, tm.assignClusters, tm.total};
+      if (r >= opt.warmup)
+        for (std::size_t p = 0; p < std::size(phases); ++p)
+          times[p].push_back(values[p]);
+      // the tiles of the last run are kept for the outputs
+      if (r + 1 < opt.warmup + opt.repeat)
+        algo.clearLayerTiles();
+    }
+
+    std::cout << opt.input << ": " << points.size() << " points, geometry " << opt.geometry << ", dc " << opt.dc
+              << ", rhoc " << opt.rhoc << ", outlierDeltaFactor " << opt.outlierDeltaFactor << ", "
+              << algo.getClusters().size() << " clusters" << std::endl;
+    for (std::size_t p = 0; p < std::size(phases); ++p)
+      clue::printTimingReport(times[p], opt.repeat, phases[p]);
+
+    if (!opt.output.empty()) {
+      algo.verbose_ = true;
+      algo.verboseResults(opt.output);
+    }
+
+    if (!opt.reference.empty()) {
+      const int failures = compareWithReference(algo, opt);
+      if (failures != 0) {
+        std::cerr << "Results different from " << opt.reference;
+        if (failures > 0)
+          std::cerr << " (" << failures << " values)";
+        std::cerr << std::endl;
+        return 1;
+      }
+      std::cout << "Same results as " << opt.reference << std::endl;
+    }
+    algo.clearLayerTiles();
+    return 0;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--geometry")
+      opt.geometry = next();
+    else if (arg == "--dc")
+      opt.dc = std::stof(next());
+    else if (arg == "--rhoc")
+      opt.rhoc = std::stof(next());
+    else if (arg == "--outlierDeltaFactor")
+      opt.outlierDeltaFactor = std::stof(next());
+    else if (arg == "--record")
+      opt.record = std::stoul(next());
+    else if (arg == "--repeat")
+      opt.repeat = std::max(1ul, std::stoul(next()));
+    else if (arg == "--warmup")
+      opt.warmup = std::stoul(next());
+    else if (arg == "--output")
+      opt.output = next();
+    else if (arg == "--reference")
+      opt.reference = next();
+    else if (arg == "--compare")
+      opt.compare = parseList(next());
+    else if (opt.input.empty() && arg[0] != '-')
+      opt.input = arg;
+    else {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (opt.input.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  clue::InputPoints points;
+  if (!readInput(opt, points))
+    return 1;
+
+  int status = 1;
+  const bool found = clue::dispatchCLUEAlgo(opt.geometry, [&](auto tag) {
+    using ALGO = typename decltype(tag)::type;
+    status = run<ALGO>(opt, points);
+  });
+  if (!found) {
+    std::cerr << "Unknown geometry " << opt.geometry << std::endl;
+    return 1;
+  }
+  return status;
+}
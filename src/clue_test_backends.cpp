@@ -0,0 +1,764 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Check of the CLUE variants which must give the same results as CLUEAlgo_T:
+// synthetic events of every geometry are clustered with CLUEAlgo_T and with
+// CLUEAlgoParallel_T on the chosen backend, or with CLUEAlgo_T using the
+// neighbour cache (NeighbourCache, and NeighbourCacheFallback with a budget
+// too small for any event), or with the density-sorted nearest-higher search
+// (DensitySorted), and the results must be identical. With the
+// seed delta cap (CapSeedDelta) only the clusters must be. With an energy
+// threshold (EnergyThreshold), CLUEAlgo_T and CLUEAlgoParallel_T must give the
+// results of CLUEAlgo_T on the hits above the threshold, the others being outliers.
+// BaselineDistance checks every geometry, the barrels also with hits on both sides
+// of phi = +-pi, against a brute-force search with the distance of the original code
+// (which, on barrels, recomputed phi = x / r for every pair): rho up to the summation
+// order, the same seeds, nearest highers and clusters, and the same delta to the last bit.
+// ScanClusters checks that CLUEAlgo_T::scanClusters() gives, for every setting, the
+// seeds and clusters of makeClusters() run with that setting alone (ScanClustersCapSeedDelta
+// with the seed delta cap of the scanning algo on), and ScanCriticalDistances
+// the same for CLUEAlgo_T::scanCriticalDistances() and every critical distance.
+// TimeWindow gives the hits random times and checks CLUEAlgo_T, with and without the
+// neighbour cache or the density-sorted search, and CLUEAlgoParallel_T against the
+// brute-force search of BaselineDistance restricted to the pairs closer in time than the window.
+// BackendKnobs checks that the algos made by makeCLUEAlgo with a backend refuse the
+// neighbour cache, the seed delta cap and the density-sorted search, which
+// CLUEAlgoParallel_T does not implement.
+// ClusterPosition checks clue::calculatePosition, the position and covariance of the
+// clusters, against a double precision two-pass computation on random clusters.
+// CompactPoints checks the round trip of clue::CompactPoints, to the precision of its
+// resolution and weight format, and the flags it packs from a clustering run.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "CLUEAlgoParallel.h"
+#include "CLUEAlgoRegistry.h"
+#include "CLUEClusterPosition.h"
+#include "CompactPoints.h"
+#include "EventGenerator.h"
+
+namespace {
+
+  template <typename EXPECTED, typename FOUND>
+  int compare(const char* name, const EXPECTED& expected, const FOUND& found) {
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      if (expected[i] != found[i]) {
+        std::cerr << "  " << name << "[" << i << "]: expected " << expected[i] << ", found " << found[i] << "\n";
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // `configure` sets up the candidate, which must use the neighbour cache if `expectCache`
+  // and must find the same delta and nearestHigher if `sameDelta`
+  template <typename ALGO, typename CANDIDATE, typename CONFIGURE>
+  int testGeometry(const char* variant, const char* geometry, CONFIGURE configure, bool expectCache = false,
+                   bool sameDelta = true) {
+    ALGO reference(15.f, 0.02f, 3.f, false);
+    CANDIDATE candidate(15.f, 0.02f, 3.f, false);
+    configure(candidate);
+
+    int failures = 0;
+    // the same instances cluster several events, to check that nothing leaks between them
+    for (std::size_t hits : {1000, 20000, 100000}) {
+      clue::GeneratorConfig cfg;
+      cfg.nHits = hits;
+      cfg.seed = hits;
+      clue::InputPoints in;
+      clue::generateEvent<typename ALGO::constants_type_t>(cfg, in);
+
+      reference.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+      candidate.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+      reference.makeClusters();
+      candidate.makeClusters();
+
+      const auto& expected = reference.getPoints();
+      const auto& found = candidate.getPoints();
+      int failed = compare("rho", expected.rho, found.rho) + compare("isSeed", expected.isSeed, found.isSeed) +
+                   compare("clusterIndex", expected.clusterIndex, found.clusterIndex);
+      if (sameDelta)
+        failed += compare("delta", expected.delta, found.delta) +
+                  compare("nearestHigher", expected.nearestHigher, found.nearestHigher);
+      if (candidate.usedNeighbourCache() != expectCache) {
+        std::cerr << "  the neighbour cache was " << (expectCache ? "not " : "") << "used\n";
+        ++failed;
+      }
+      std::cout << (failed ? "FAILED " : "OK     ") << variant << " " << geometry << " " << hits << " hits, "
+                << reference.getClusters().size() << " clusters\n";
+      failures += failed > 0;
+
+      reference.clearLayerTiles();
+      candidate.clearLayerTiles();
+    }
+    return failures;
+  }
+
+  template <typename BACKEND>
+  int testBackend() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      failures += testGeometry<ALGO, CLUEAlgoParallel_T<typename ALGO::tiles_type, BACKEND>>(BACKEND::name, name,
+                                                                                            [](auto&) {});
+    });
+    return failures;
+  }
+
+  int testNeighbourCache(const char* variant, std::size_t budget, bool expectCache) {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      failures += testGeometry<ALGO, ALGO>(
+          variant, name, [budget](auto& algo) { algo.neighbourCacheBytes_ = budget; }, expectCache);
+    });
+    return failures;
+  }
+
+  int testCapSeedDelta() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      failures += testGeometry<ALGO, ALGO>(
+          "CapSeedDelta", name, [](auto& algo) { algo.capSeedDelta_ = true; }, false, false);
+    });
+    return failures;
+  }
+
+  int testDensitySorted() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      failures += testGeometry<ALGO, ALGO>(
+          "DensitySorted", name, [](auto& algo) { algo.deltaEngine_ = CLUEDeltaEngine::DensitySorted; });
+    });
+    return failures;
+  }
+
+  // CLUEAlgo_T on the points of `in` with a weight of at least `threshold`, with the results
+  // mapped back to all the points
+  template <typename ALGO>
+  Points clusterAboveThreshold(const clue::InputPoints& in, float threshold) {
+    clue::InputPoints kept;
+    std::vector<int> index;
+    for (std::size_t i = 0; i < in.size(); ++i) {
+      if (in.weight[i] < threshold)
+        continue;
+      kept.x.push_back(in.x[i]);
+      kept.y.push_back(in.y[i]);
+      kept.r.push_back(in.r[i]);
+      kept.layer.push_back(in.layer[i]);
+      kept.weight.push_back(in.weight[i]);
+      index.push_back(i);
+    }
+    ALGO algo(15.f, 0.02f, 3.f, false);
+    algo.clearAndSetPoints(kept.size(), kept.x.data(), kept.y.data(), kept.layer.data(), kept.weight.data(), kept.r.data());
+    algo.makeClusters();
+    const auto& p = algo.getPoints();
+
+    Points all;
+    all.rho.assign(in.size(), 0.f);
+    all.delta.assign(in.size(), std::numeric_limits<float>::max());
+    all.nearestHigher.assign(in.size(), -1);
+    all.clusterIndex.assign(in.size(), -1);
+    all.isSeed.assign(in.size(), 0);
+    for (std::size_t k = 0; k < index.size(); ++k) {
+      all.rho[index[k]] = p.rho[k];
+      all.delta[index[k]] = p.delta[k];
+      all.nearestHigher[index[k]] = p.nearestHigher[k] >= 0 ? index[p.nearestHigher[k]] : -1;
+      all.clusterIndex[index[k]] = p.clusterIndex[k];
+      all.isSeed[index[k]] = p.isSeed[k];
+    }
+    return all;
+  }
+
+  template <typename ALGO>
+  int compareAboveThreshold(const char* variant, const char* geometry, ALGO& candidate) {
+    int failures = 0;
+    for (std::size_t hits : {1000, 20000, 100000}) {
+      clue::GeneratorConfig cfg;
+      cfg.nHits = hits;
+      cfg.seed = hits;
+      clue::InputPoints in;
+      clue::generateEvent<typename ALGO::constants_type_t>(cfg, in);
+      // about a third of the hits are dropped
+      std::vector<float> weights(in.weight.begin(), in.weight.end());
+      std::nth_element(weights.begin(), weights.begin() + weights.size() / 3, weights.end());
+      candidate.energyThreshold_ = weights[weights.size() / 3];
+
+      const Points expected = clusterAboveThreshold<CLUEAlgo_T<typename ALGO::tiles_type>>(in, candidate.energyThreshold_);
+      candidate.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+      candidate.makeClusters();
+      const auto& found = candidate.getPoints();
+      int failed = compare("rho", expected.rho, found.rho) + compare("delta", expected.delta, found.delta) +
+                   compare("nearestHigher", expected.nearestHigher, found.nearestHigher) +
+                   compare("isSeed", expected.isSeed, found.isSeed) +
+                   compare("clusterIndex", expected.clusterIndex, found.clusterIndex);
+      if (found.n != in.size() || !std::equal(in.weight.begin(), in.weight.end(), found.weight.begin())) {
+        std::cerr << "  the points are not back in the input order\n";
+        ++failed;
+      }
+      std::cout << (failed ? "FAILED " : "OK     ") << variant << " " << geometry << " " << hits << " hits\n";
+      failures += failed > 0;
+      candidate.clearLayerTiles();
+    }
+
+    // no point above the threshold: all are outliers
+    clue::InputPoints in;
+    clue::generateEvent<typename ALGO::constants_type_t>(clue::GeneratorConfig{}, in);
+    candidate.energyThreshold_ = *std::max_element(in.weight.begin(), in.weight.end()) * 2.f;
+    candidate.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+    candidate.makeClusters();
+    const auto& found = candidate.getPoints();
+    if (found.n != in.size() || std::count(found.clusterIndex.begin(), found.clusterIndex.end(), -1) != long(in.size())) {
+      std::cerr << "FAILED " << variant << " " << geometry << ": hits below the threshold are not outliers\n";
+      ++failures;
+    }
+    candidate.clearLayerTiles();
+    return failures;
+  }
+
+  int testEnergyThreshold() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      ALGO serial(15.f, 0.02f, 3.f, false);
+      failures += compareAboveThreshold("EnergyThreshold", name, serial);
+      CLUEAlgoParallel_T<typename ALGO::tiles_type, clue::backend::Tbb> parallel(15.f, 0.02f, 3.f, false);
+      failures += compareAboveThreshold("EnergyThreshold Tbb", name, parallel);
+    });
+    return failures;
+  }
+
+  // squared distance of the original CLUE code, measured on the cylinder of i on barrels
+  template <bool ENDCAP>
+  float baselineDistance2(const Points& p, int i, int j) {
+    if constexpr (ENDCAP) {
+      const float dx = p.x[i] - p.x[j];
+      const float dy = p.y[i] - p.y[j];
+      return dx * dx + dy * dy;
+    } else {
+      const float phi_i = p.x[i] / p.r[i];
+      const float phi_j = p.x[j] / p.r[j];
+      const float drphi = p.r[i] * reco::deltaPhi(phi_i, phi_j);
+      const float dy = p.y[i] - p.y[j];
+      return dy * dy + drphi * drphi;
+    }
+  }
+
+  // moves every fourth point within 15 of the arc at phi = +-pi, some of them beyond it,
+  // as x = r * phi can be when phi is a rounded angle
+  void moveToSeam(clue::InputPoints& in) {
+    for (std::size_t i = 0; i < in.size(); i += 4) {
+      const float offset = std::fmod(std::abs(in.x[i]), 30.f) - 15.f;
+      in.x[i] = std::copysign(in.r[i] * static_cast<float>(M_PI) + offset, in.x[i]);
+    }
+  }
+
+  // checks the results of `algo` point by point against a brute-force search of every layer
+  // with baselineDistance2, and with a positive timeWindow only between the points with
+  // t_i - timeWindow < t_j < t_i + timeWindow: the same neighbours, delta, nearest highers
+  // (up to exact ties), seeds, outliers and clusters
+  template <typename ALGO>
+  int compareToBaseline(const ALGO& algo, float dc, float rhoc, float outlierDeltaFactor, float timeWindow = 0.f) {
+    constexpr bool endcap = ALGO::constants_type_t::endcap;
+    const auto& p = algo.getPoints();
+    const float dc2 = dc * dc;
+    const float dm = outlierDeltaFactor * dc;
+    std::vector<std::vector<int>> layers(ALGO::constants_type_t::nLayers);
+    for (std::size_t i = 0; i < p.n; ++i)
+      layers[p.layer[i]].push_back(i);
+
+    int failed = 0;
+    auto fail = [&](const char* what, int i) {
+      if (failed++ == 0)
+        std::cerr << "  " << what << " of point " << i << ": rho " << p.rho[i] << ", delta " << p.delta[i]
+                  << ", nearestHigher " << p.nearestHigher[i] << "\n";
+    };
+    for (const auto& layer : layers) {
+      for (int i : layer) {
+        float rho = 0.f;
+        float delta2 = std::numeric_limits<float>::max();
+        int nearestHigher = -1;
+        for (int j : layer) {
+          if (timeWindow > 0.f && !(p.time[j] > p.time[i] - timeWindow && p.time[j] < p.time[i] + timeWindow))
+            continue;
+          const float d2 = baselineDistance2<endcap>(p, i, j);
+          if (d2 <= dc2)
+            rho += (i == j ? 1.f : 0.5f) * p.weight[j];
+          const bool higher = p.rho[j] > p.rho[i] || (p.rho[j] == p.rho[i] && j > i);
+          if (higher && std::sqrt(d2) <= dm && d2 < delta2) {
+            delta2 = d2;
+            nearestHigher = j;
+          }
+        }
+        // the density is summed in another order
+        if (std::abs(rho - p.rho[i]) > 1e-5f * rho)
+          fail("rho", i);
+
+        const int nh = p.nearestHigher[i];
+        const float delta = nh < 0 ? std::numeric_limits<float>::max() : std::sqrt(baselineDistance2<endcap>(p, i, nh));
+        if ((nh < 0) != (nearestHigher < 0) || (nh >= 0 && delta != std::sqrt(delta2)))
+          fail("nearestHigher", i);
+        else if (delta != p.delta[i])
+          fail("delta", i);
+
+        const bool isSeed = delta > dc && p.rho[i] >= rhoc;
+        const bool isOutlier = delta > dm && p.rho[i] < rhoc;
+        if (isSeed != bool(p.isSeed[i]))
+          fail("isSeed", i);
+        else if (!isSeed && p.clusterIndex[i] != (isOutlier ? -1 : p.clusterIndex[nh]))
+          fail("clusterIndex", i);
+      }
+    }
+    return failed;
+  }
+
+  int testBaselineDistance() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      ALGO algo(15.f, 0.02f, 3.f, false);
+      for (std::size_t hits : {1000, 20000}) {
+        for (bool seam : {false, true}) {
+          if (seam && ALGO::constants_type_t::endcap)
+            continue;
+          clue::GeneratorConfig cfg;
+          cfg.nHits = hits;
+          cfg.seed = hits;
+          clue::InputPoints in;
+          clue::generateEvent<typename ALGO::constants_type_t>(cfg, in);
+          if (seam)
+            moveToSeam(in);
+          algo.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+          algo.makeClusters();
+          const int failed = compareToBaseline(algo, 15.f, 0.02f, 3.f);
+          std::cout << (failed ? "FAILED " : "OK     ") << "BaselineDistance " << name << " " << hits << " hits"
+                    << (seam ? " at phi = +-pi\n" : "\n");
+          failures += failed > 0;
+          algo.clearLayerTiles();
+        }
+      }
+    });
+    return failures;
+  }
+
+  template <typename ALGO>
+  int compareTimeWindow(const char* variant, const char* geometry, ALGO& algo) {
+    int failures = 0;
+    for (std::size_t hits : {1000, 20000}) {
+      clue::GeneratorConfig cfg;
+      cfg.nHits = hits;
+      cfg.seed = hits;
+      clue::InputPoints in;
+      clue::generateEvent<typename ALGO::constants_type_t>(cfg, in);
+      // times in [0, 10) in steps of 0.01, so that some points have the same time
+      std::mt19937 rng(hits);
+      std::uniform_int_distribution<int> tick(0, 999);
+      std::vector<float> time(in.size());
+      for (auto& t : time)
+        t = tick(rng) * 0.01f;
+
+      for (float timeWindow : {0.5f, 2.f}) {
+        algo.timeWindow_ = timeWindow;
+        algo.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data(),
+                               time.data());
+        algo.makeClusters();
+        const int failed = compareToBaseline(algo, 15.f, 0.02f, 3.f, timeWindow);
+        std::cout << (failed ? "FAILED " : "OK     ") << variant << " " << geometry << " " << hits
+                  << " hits, window " << timeWindow << ", " << algo.getClusters().size() << " clusters\n";
+        failures += failed > 0;
+        algo.clearLayerTiles();
+      }
+    }
+    return failures;
+  }
+
+  int testTimeWindow() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      ALGO serial(15.f, 0.02f, 3.f, false);
+      failures += compareTimeWindow("TimeWindow", name, serial);
+      ALGO cached(15.f, 0.02f, 3.f, false);
+      cached.neighbourCacheBytes_ = std::size_t(1) << 30;
+      failures += compareTimeWindow("TimeWindow NeighbourCache", name, cached);
+      ALGO sorted(15.f, 0.02f, 3.f, false);
+      sorted.deltaEngine_ = CLUEDeltaEngine::DensitySorted;
+      failures += compareTimeWindow("TimeWindow DensitySorted", name, sorted);
+      CLUEAlgoParallel_T<typename ALGO::tiles_type, clue::backend::Tbb> parallel(15.f, 0.02f, 3.f, false);
+      failures += compareTimeWindow("TimeWindow Tbb", name, parallel);
+    });
+    return failures;
+  }
+
+  // checks the seeds, clusters and their counts of one scan setting against makeClusters() of `reference`
+  template <typename ALGO>
+  int compareScanResult(const CLUEScanResult& res, const ALGO& reference) {
+    const auto& expected = reference.getPoints();
+    int failed = compare("isSeed", expected.isSeed, res.isSeed) +
+                 compare("clusterIndex", expected.clusterIndex, res.clusterIndex);
+    const int nSeeds = std::count(expected.isSeed.begin(), expected.isSeed.end(), 1);
+    const int nOutliers = std::count(expected.clusterIndex.begin(), expected.clusterIndex.end(), -1);
+    if (res.isSeed.size() != expected.n || res.nSeeds != nSeeds || res.nOutliers != nOutliers) {
+      std::cerr << "  " << res.isSeed.size() << " points, " << res.nSeeds << " seeds and " << res.nOutliers
+                << " outliers, expected " << expected.n << ", " << nSeeds << " and " << nOutliers << "\n";
+      ++failed;
+    }
+    return failed;
+  }
+
+  int testScanClusters(const char* variant, bool capSeedDelta) {
+    const std::vector<std::pair<float, float>> settings = {{0.02f, 3.f}, {0.02f, 1.f}, {0.05f, 2.f},
+                                                           {0.1f, 4.f},  {0.2f, 1.5f}, {0.2f, 3.f}};
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      ALGO scan(15.f, 0.02f, 3.f, false);
+      scan.capSeedDelta_ = capSeedDelta;
+      for (std::size_t hits : {1000, 20000}) {
+        clue::GeneratorConfig cfg;
+        cfg.nHits = hits;
+        cfg.seed = hits;
+        clue::InputPoints in;
+        clue::generateEvent<typename ALGO::constants_type_t>(cfg, in);
+        scan.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+        const auto results = scan.scanClusters(settings);
+        scan.clearLayerTiles();
+
+        int failed = results.size() != settings.size();
+        for (std::size_t k = 0; k < results.size(); ++k) {
+          ALGO reference(15.f, settings[k].first, settings[k].second, false);
+          reference.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(),
+                                      in.r.data());
+          reference.makeClusters();
+          failed += compareScanResult(results[k], reference);
+        }
+        std::cout << (failed ? "FAILED " : "OK     ") << variant << " " << name << " " << hits << " hits, "
+                  << results.front().nSeeds << " to " << results.back().nSeeds << " clusters\n";
+        failures += failed > 0;
+      }
+    });
+    return failures;
+  }
+
+  int testScanCriticalDistances() {
+    // not sorted, as the scan returns them by increasing dc
+    const std::vector<float> dcs = {15.f, 5.f, 25.f, 10.f, 20.f};
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      ALGO scan(15.f, 0.02f, 3.f, false);
+      for (std::size_t hits : {1000, 20000}) {
+        clue::GeneratorConfig cfg;
+        cfg.nHits = hits;
+        cfg.seed = hits;
+        clue::InputPoints in;
+        clue::generateEvent<typename ALGO::constants_type_t>(cfg, in);
+        scan.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+        const auto results = scan.scanCriticalDistances(dcs);
+        scan.clearLayerTiles();
+
+        int failed = results.size() != dcs.size();
+        for (std::size_t k = 0; k < results.size(); ++k) {
+          if (k > 0 && results[k].dc <= results[k - 1].dc) {
+            std::cerr << "  dc " << results[k].dc << " after " << results[k - 1].dc << "\n";
+            ++failed;
+          }
+          ALGO reference(results[k].dc, 0.02f, 3.f, false);
+          reference.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(),
+                                      in.r.data());
+          reference.makeClusters();
+          failed += compareScanResult(results[k], reference);
+        }
+        std::cout << (failed ? "FAILED " : "OK     ") << "ScanCriticalDistances " << name << " " << hits << " hits, "
+                  << results.front().nSeeds << " to " << results.back().nSeeds << " clusters\n";
+        failures += failed > 0;
+      }
+    });
+    return failures;
+  }
+
+  // the knobs of CLUEAlgo_T must be rejected, not dropped, by CLUEAlgoParallel_T
+  int testBackendKnobs() {
+    int failures = 0;
+    auto check = [&](bool ok, const std::string& what, const std::string& backend) {
+      std::cout << (ok ? "OK     " : "FAILED ") << "BackendKnobs " << what << " "
+                << (backend.empty() ? "sequential" : backend) << "\n";
+      failures += !ok;
+    };
+    std::vector<std::string> backends = clue::clueBackendNames();
+    backends.insert(backends.begin(), "");
+    for (const auto& backend : backends) {
+      const bool sequential = backend.empty();
+      auto algo = clue::makeCLUEAlgo("CLICdetEndcap", 15.f, 0.02f, 3.f, false, false, backend);
+      check(algo->setNeighbourCache(std::size_t(1) << 20) == sequential, "NeighbourCache", backend);
+      check(algo->setNeighbourCache(0), "no NeighbourCache", backend);
+      check(algo->setCapSeedDelta(true) == sequential, "CapSeedDelta", backend);
+      check(algo->setCapSeedDelta(false), "no CapSeedDelta", backend);
+      check(algo->setDeltaEngine(CLUEDeltaEngine::DensitySorted) == sequential, "DensitySorted", backend);
+      check(algo->setDeltaEngine(CLUEDeltaEngine::Tiles), "Tiles", backend);
+    }
+    return failures;
+  }
+
+  // clue::calculatePosition in double precision, with a second pass for the covariance
+  bool referencePosition(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                         const std::vector<float>& energy, float thresholdW0, std::array<double, 9>& ref) {
+    double totalEnergy = 0.;
+    for (float e : energy)
+      totalEnergy += e;
+    if (!(totalEnergy > 0.))
+      return false;
+    std::vector<double> w(energy.size());
+    double sumW = 0., sumW2 = 0., mx = 0., my = 0., mz = 0.;
+    for (std::size_t i = 0; i < energy.size(); ++i) {
+      w[i] = std::max(0., thresholdW0 + std::log(energy[i] / totalEnergy));
+      sumW += w[i];
+      sumW2 += w[i] * w[i];
+      mx += w[i] * x[i];
+      my += w[i] * y[i];
+      mz += w[i] * z[i];
+    }
+    if (sumW == 0.)
+      return false;
+    mx /= sumW;
+    my /= sumW;
+    mz /= sumW;
+    ref = {mx, my, mz, 0., 0., 0., 0., 0., 0.};
+    for (std::size_t i = 0; i < energy.size(); ++i) {
+      const double d[3] = {x[i] - mx, y[i] - my, z[i] - mz};
+      // xx, yx, yy, zx, zy, zz
+      int k = 3;
+      for (int a = 0; a < 3; ++a)
+        for (int b = 0; b <= a; ++b)
+          ref[k++] += w[i] * d[a] * d[b];
+    }
+    for (int k = 3; k < 9; ++k)
+      ref[k] *= sumW2 / (sumW * sumW * sumW);
+    return true;
+  }
+
+  // clue::calculatePosition against referencePosition on random clusters
+  int testClusterPosition() {
+    std::mt19937 gen(46);
+    std::uniform_real_distribution<float> centre(-2000.f, 2000.f);
+    std::uniform_real_distribution<float> logEnergy(-7.f, 0.f);
+    std::uniform_real_distribution<float> spread(5.f, 100.f);
+    std::vector<std::size_t> sizes = {1, 2, 7, 8, 9, 16, 100, 3000};
+    for (int k = 0; k < 200; ++k)
+      sizes.push_back(std::uniform_int_distribution<std::size_t>(1, 3000)(gen));
+
+    int failures = 0;
+    double maxPositionError = 0., maxCovarianceError = 0.;
+    for (std::size_t n : sizes) {
+      std::vector<float> x(n), y(n), z(n), energy(n);
+      const float cx = centre(gen), cy = centre(gen), cz = centre(gen), sigma = spread(gen);
+      std::normal_distribution<float> offset(0.f, sigma);
+      for (std::size_t i = 0; i < n; ++i) {
+        x[i] = cx + offset(gen);
+        y[i] = cy + offset(gen);
+        z[i] = cz + offset(gen) * 0.1f;
+        energy[i] = std::exp(logEnergy(gen));
+      }
+      std::array<double, 9> ref;
+      const bool expected = referencePosition(x, y, z, energy, 2.9f, ref);
+      clue::ClusterPosition position;
+      const bool found = clue::calculatePosition(x, y, z, energy, 2.9f, position);
+      int failed = expected != found;
+      if (expected && found) {
+        const float p[3] = {position.x, position.y, position.z};
+        for (int a = 0; a < 3; ++a) {
+          // relative to the size of the cluster and to the float resolution of the coordinate
+          const double error = std::abs(p[a] - ref[a]) / (std::sqrt(ref[3 + a * (a + 3) / 2]) + std::abs(ref[a]) * 1e-3);
+          maxPositionError = std::max(maxPositionError, error);
+          failed += !(error < 1e-3);
+        }
+        int k = 0;
+        for (int a = 0; a < 3; ++a)
+          for (int b = 0; b <= a; ++b, ++k) {
+            const double scale = std::sqrt(ref[3 + a * (a + 3) / 2] * ref[3 + b * (b + 3) / 2]);
+            const double error = std::abs(position.covariance[k] - ref[3 + k]) / (scale + 1e-6);
+            maxCovarianceError = std::max(maxCovarianceError, error);
+            failed += !(error < 1e-3);
+          }
+      }
+      if (failed)
+        std::cerr << "  cluster of " << n << " hits\n";
+      failures += failed > 0;
+    }
+
+    // no energy
+    std::vector<float> zero(5, 0.f);
+    clue::ClusterPosition position;
+    if (clue::calculatePosition(zero, zero, zero, zero, 2.9f, position)) {
+      std::cerr << "  cluster without energy\n";
+      ++failures;
+    }
+    // the hits with less than exp(-2.9) of the energy, or none, do not move the position
+    std::vector<float> x = {0.f, 100.f, -100.f}, y(3, 0.f), energy = {1.f, 0.01f, 0.f};
+    if (!clue::calculatePosition(x, y, y, energy, 2.9f, position) || position.x != 0.f ||
+        position.covariance[0] != 0.f) {
+      std::cerr << "  soft hits in the position\n";
+      ++failures;
+    }
+    std::cout << (failures ? "FAILED " : "OK     ") << "ClusterPosition " << sizes.size()
+              << " clusters, max relative errors " << maxPositionError << " (position), " << maxCovarianceError
+              << " (covariance)\n";
+    return failures;
+  }
+
+  // round trip of clue::CompactPoints: the coordinates within half a resolution step
+  // (and the float rounding of the cell centre), the layers, the original order, the
+  // weights to the precision of their format, and the flags of the clustering
+  int testCompactPoints() {
+    int failures = 0;
+    clue::forEachCLUEAlgo([&](auto tag, const char* name) {
+      using ALGO = typename decltype(tag)::type;
+      using Constants = typename ALGO::constants_type_t;
+      ALGO algo(15.f, 0.02f, 3.f, false);
+      for (std::size_t hits : {1000, 20000}) {
+        clue::GeneratorConfig cfg;
+        cfg.nHits = hits;
+        cfg.seed = hits;
+        clue::InputPoints in, out;
+        clue::generateEvent<Constants>(cfg, in);
+        const std::size_t n = in.size();
+
+        int failed = 0;
+        for (float resolution : {0.01f, 0.1f}) {
+          for (auto format : {clue::WeightFormat::Float32, clue::WeightFormat::Float16, clue::WeightFormat::BFloat16}) {
+            clue::CompactPoints<Constants> compact(resolution, format);
+            compact.compress(in);
+            compact.decompress(out);
+            // relative precision of the weights, for the normal numbers of the format
+            const float precision = format == clue::WeightFormat::Float32   ? 0.f
+                                    : format == clue::WeightFormat::Float16 ? std::ldexp(1.f, -11)
+                                                                            : std::ldexp(1.f, -8);
+            const float minNormal = format == clue::WeightFormat::Float16 ? std::ldexp(1.f, -14) : 0.f;
+            std::size_t wrong = compact.nSaturated() + (out.size() != n);
+            for (std::size_t i = 0; i < n && out.size() == n; ++i) {
+              const float ulps = 4.f * std::numeric_limits<float>::epsilon();
+              wrong += !(std::abs(out.x[i] - in.x[i]) <= 0.5f * resolution + ulps * std::abs(in.x[i]));
+              wrong += !(std::abs(out.y[i] - in.y[i]) <= 0.5f * resolution + ulps * std::abs(in.y[i]));
+              // endcaps recompute r from x and y
+              wrong += !(std::abs(out.r[i] - in.r[i]) <= 0.71f * resolution + ulps * std::abs(in.r[i]));
+              wrong += out.layer[i] != in.layer[i];
+              if (in.weight[i] >= minNormal)
+                wrong += !(std::abs(out.weight[i] - in.weight[i]) <= precision * in.weight[i]);
+            }
+            if (wrong) {
+              std::cerr << "  resolution " << resolution << ", weight format " << int(format) << ": " << wrong
+                        << " wrong values, " << compact.nSaturated() << " saturated\n";
+              ++failed;
+            }
+
+            algo.clearAndSetPoints(n, out.x.data(), out.y.data(), out.layer.data(), out.weight.data(), out.r.data());
+            algo.makeClusters();
+            const auto& points = algo.getPoints();
+            compact.setFlags(points);
+            std::size_t wrongFlags = 0;
+            for (std::size_t k = 0; k < compact.size(); ++k) {
+              const auto i = compact.originalIndex(k);
+              wrongFlags += compact.isSeed(k) != bool(points.isSeed[i]) ||
+                            compact.isOutlier(k) != (points.clusterIndex[i] < 0) ||
+                            compact.layer(k) != in.layer[i];
+            }
+            algo.clearLayerTiles();
+            if (wrongFlags) {
+              std::cerr << "  resolution " << resolution << ", weight format " << int(format) << ": " << wrongFlags
+                        << " wrong flags\n";
+              ++failed;
+            }
+          }
+        }
+        // finer than int16 offsets can hold for the tiles
+        try {
+          clue::CompactPoints<Constants> tooFine(1e-6f);
+          std::cerr << "  resolution 1e-6 accepted\n";
+          ++failed;
+        } catch (const std::invalid_argument&) {
+        }
+        std::cout << (failed ? "FAILED " : "OK     ") << "CompactPoints " << name << " " << hits << " hits\n";
+        failures += failed > 0;
+      }
+    });
+    return failures;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  const std::string backend = argc > 1 ? argv[1] : "";
+  int failures = 0;
+  if (backend == "Serial") {
+    failures = testBackend<clue::backend::Serial>();
+  } else if (backend == "Threads") {
+    // more threads than cores, to split the kernels even on a small machine
+    clue::backend::Threads::nThreads = 4;
+    failures = testBackend<clue::backend::Threads>();
+  } else if (backend == "Tbb") {
+    failures = testBackend<clue::backend::Tbb>();
+  } else if (backend == "NeighbourCache") {
+    failures = testNeighbourCache("NeighbourCache", std::size_t(1) << 30, true);
+  } else if (backend == "NeighbourCacheFallback") {
+    failures = testNeighbourCache("NeighbourCacheFallback", 1024, false);
+  } else if (backend == "CapSeedDelta") {
+    failures = testCapSeedDelta();
+  } else if (backend == "DensitySorted") {
+    failures = testDensitySorted();
+  } else if (backend == "EnergyThreshold") {
+    failures = testEnergyThreshold();
+  } else if (backend == "BaselineDistance") {
+    failures = testBaselineDistance();
+  } else if (backend == "ScanClusters") {
+    failures = testScanClusters("ScanClusters", false);
+  } else if (backend == "ScanClustersCapSeedDelta") {
+    failures = testScanClusters("ScanClustersCapSeedDelta", true);
+  } else if (backend == "ScanCriticalDistances") {
+    failures = testScanCriticalDistances();
+  } else if (backend == "TimeWindow") {
+    failures = testTimeWindow();
+  } else if (backend == "BackendKnobs") {
+    failures = testBackendKnobs();
+  } else if (backend == "ClusterPosition") {
+    failures = testClusterPosition();
+  } else if (backend == "CompactPoints") {
+    failures = testCompactPoints();
+  } else {
+    std::cerr << "Usage: " << argv[0]
+              << " Serial|Threads|Tbb|NeighbourCache|NeighbourCacheFallback|CapSeedDelta|DensitySorted|EnergyThreshold|BaselineDistance|ScanClusters"
+              << "|ScanClustersCapSeedDelta|ScanCriticalDistances|TimeWindow|BackendKnobs|ClusterPosition|CompactPoints"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures > 0) {
+    std::cerr << failures << " events with different results" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+// Accuracy of the compact point storage (CompactPoints.h) against the float
+// one. For every geometry, one synthetic event is compressed and decompressed
+// at every resolution and weight format of the options, and CLUE is run on
+// the restored inputs: each row of the table gives the size of the storage,
+// the quantization errors and how many seeds, nearest highers and cluster
+// assignments are the ones of the float inputs.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CLUEAlgoRegistry.h"
+#include "CompactPoints.h"
+#include "EventGenerator.h"
+
+namespace {
+
+  struct Options {
+    std::vector<std::string> geometries;
+    std::size_t hits = 100000;
+    std::vector<float> resolutions{0.001f, 0.01f, 0.1f, 1.f};
+    std::vector<std::string> weightFormats{"float32", "float16", "bfloat16"};
+    float dc = 15.f;
+    float rhoc = 0.02f;
+    float outlierDeltaFactor = 3.f;
+    std::uint64_t seed = 42;
+    bool csv = false;
+  };
+
+  void usage(const char* name) {
+    std::cout << "Usage: " << name << " [options]\n"
+              << "  --geometry NAME       geometry to run on (repeatable, default: all)\n"
+              << "  --hits N              number of hits of the event (default: 100000)\n"
+              << "  --resolution R1,R2,.. quantization steps of the coordinates [mm] (default: 0.001,0.01,0.1,1)\n"
+              << "  --weights F1,F2,...   weight formats: float32, float16, bfloat16 (default: all)\n"
+              << "  --dc, --rhoc, --outlierDeltaFactor  CLUE parameters (default: 15, 0.02, 3)\n"
+              << "  --seed S              generator seed (default: 42)\n"
+              << "  --csv                 print the table as csv\n";
+  }
+
+  std::vector<std::string> split(const std::string& s) {
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+      items.push_back(item);
+    return items;
+  }
+
+  bool weightFormatFromName(const std::string& name, clue::WeightFormat& format) {
+    if (name == "float32")
+      format = clue::WeightFormat::Float32;
+    else if (name == "float16")
+      format = clue::WeightFormat::Float16;
+    else if (name == "bfloat16")
+      format = clue::WeightFormat::BFloat16;
+    else
+      return false;
+    return true;
+  }
+
+  // index of the seed of the cluster of every point, -1 for outliers
+  std::vector<int> seedOfCluster(const Points& points) {
+    std::vector<int> seedOf;
+    for (std::size_t i = 0; i < points.n; ++i) {
+      if (points.isSeed[i]) {
+        if (points.clusterIndex[i] >= int(seedOf.size()))
+          seedOf.resize(points.clusterIndex[i] + 1, -1);
+        seedOf[points.clusterIndex[i]] = i;
+      }
+    }
+    std::vector<int> result(points.n, -1);
+    for (std::size_t i = 0; i < points.n; ++i)
+      if (points.clusterIndex[i] >= 0)
+        result[i] = seedOf[points.clusterIndex[i]];
+    return result;
+  }
+
+  // the results compared by the table, copied out of the algo
+  struct Clustering {
+    std::vector<int> isSeed;
+    std::vector<int> nearestHigher;
+    std::vector<int> seedOf;
+  };
+
+  template <typename ALGO>
+  Clustering cluster(ALGO& algo, const clue::InputPoints& in) {
+    algo.clearAndSetPoints(in.size(), in.x.data(), in.y.data(), in.layer.data(), in.weight.data(), in.r.data());
+    algo.makeClusters();
+    const auto& p = algo.getPoints();
+    Clustering result{{p.isSeed.begin(), p.isSeed.end()},
+                      {p.nearestHigher.begin(), p.nearestHigher.end()},
+                      seedOfCluster(p)};
+    algo.clearLayerTiles();
+    return result;
+  }
+
+  void printHeader(bool csv) {
+    if (csv) {
+      std::cout << "geometry,hits,resolution_mm,weights,bytes_per_point,max_dxy_mm,max_dr_mm,saturated,"
+                << "weight_mean_rel_error,weight_max_rel_error,seeds_float,seeds_compact,seeds_in_common,"
+                << "same_nearest_higher_pct,same_cluster_pct,flag_mismatches\n";
+      return;
+    }
+    std::cout << std::left << std::setw(15) << "geometry" << std::right << std::setw(8) << "res mm" << std::setw(10)
+              << "weights" << std::setw(8) << "B/pt" << std::setw(11) << "max dxy" << std::setw(11) << "max dr"
+              << std::setw(11) << "w mean" << std::setw(11) << "w max" << std::setw(8) << "seeds" << std::setw(8)
+              << "common" << std::setw(9) << "same nh" << std::setw(9) << "same cl" << "\n";
+  }
+
+  template <typename ALGO>
+  void validate(const Options& opt, const std::string& geometry) {
+    using Constants = typename ALGO::constants_type_t;
+    clue::GeneratorConfig cfg;
+    cfg.nHits = opt.hits;
+    cfg.seed = opt.seed;
+    clue::InputPoints original, restored;
+    clue::generateEvent<Constants>(cfg, original);
+    const std::size_t n = original.size();
+
+    ALGO algo(opt.dc, opt.rhoc, opt.outlierDeltaFactor, false);
+    const Clustering reference = cluster(algo, original);
+    const auto seedsReference = std::count(reference.isSeed.begin(), reference.isSeed.end(), 1);
+    // inputs plus isSeed and clusterIndex, which the compact flags replace
+    const double floatBytes = 5 * sizeof(float) + 3 * sizeof(int);
+
+    for (float resolution : opt.resolutions) {
+      for (const auto& formatName : opt.weightFormats) {
+        clue::WeightFormat format = clue::WeightFormat::Float32;
+        weightFormatFromName(formatName, format);
+        if (!opt.csv)
+          std::cout << std::left << std::setw(15) << geometry << std::right << std::setw(8) << resolution
+                    << std::setw(10) << formatName;
+        std::unique_ptr<clue::CompactPoints<Constants>> compact;
+        try {
+          compact = std::make_unique<clue::CompactPoints<Constants>>(resolution, format);
+        } catch (const std::invalid_argument&) {
+          if (!opt.csv)
+            std::cout << "   too fine for the tiles of the geometry\n";
+          continue;
+        }
+        compact->compress(original);
+        compact->decompress(restored);
+
+        float maxDxy = 0.f, maxDr = 0.f, maxWeightError = 0.f;
+        double sumWeightError = 0.;
+        for (std::size_t i = 0; i < n; ++i) {
+          maxDxy = std::max({maxDxy, std::abs(restored.x[i] - original.x[i]), std::abs(restored.y[i] - original.y[i])});
+          maxDr = std::max(maxDr, std::abs(restored.r[i] - original.r[i]));
+          if (original.weight[i] > 0.f) {
+            const float error = std::abs(restored.weight[i] / original.weight[i] - 1.f);
+            maxWeightError = std::max(maxWeightError, error);
+            sumWeightError += error;
+          }
+        }
+
+        const Clustering quantized = cluster(algo, restored);
+        compact->setFlags(algo.getPoints());
+        std::size_t flagMismatches = 0, seedsQuantized = 0, sameSeed = 0, sameNearestHigher = 0, sameCluster = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+          const auto i = compact->originalIndex(k);
+          flagMismatches += compact->isSeed(k) != bool(quantized.isSeed[i]) ||
+                            compact->isOutlier(k) != (quantized.seedOf[i] < 0);
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+          seedsQuantized += quantized.isSeed[i];
+          sameSeed += reference.isSeed[i] && quantized.isSeed[i];
+          sameNearestHigher += reference.nearestHigher[i] == quantized.nearestHigher[i];
+          sameCluster += reference.seedOf[i] == quantized.seedOf[i];
+        }
+
+        const double bytesPerPoint = double(compact->bytes()) / n;
+        if (opt.csv) {
+          std::cout << geometry << "," << n << "," << resolution << "," << formatName << "," << bytesPerPoint << ","
+                    << maxDxy << "," << maxDr << "," << compact->nSaturated() << "," << sumWeightError / n << ","
+                    << maxWeightError << "," << seedsReference << "," << seedsQuantized << "," << sameSeed << ","
+                    << 100. * sameNearestHigher / n << "," << 100. * sameCluster / n << "," << flagMismatches
+                    << "\n";
+        } else {
+          std::cout << std::fixed << std::setprecision(1) << std::setw(8) << bytesPerPoint << std::scientific
+                    << std::setprecision(2) << std::setw(11) << maxDxy << std::setw(11) << maxDr << std::setw(11)
+                    << sumWeightError / n << std::setw(11) << maxWeightError << std::setw(8) << seedsQuantized
+                    << std::setw(8) << sameSeed << std::fixed << std::setw(8) << 100. * sameNearestHigher / n << "%"
+                    << std::setw(8) << 100. * sameCluster / n << "%";
+          if (compact->nSaturated() > 0 || flagMismatches > 0)
+            std::cout << "  (" << compact->nSaturated() << " saturated, " << flagMismatches << " flag mismatches)";
+          std::cout << "\n";
+          std::cout.unsetf(std::ios::fixed | std::ios::scientific);
+        }
+      }
+    }
+    if (!opt.csv)
+      std::cout << std::left << std::setw(15) << geometry << std::right << " float inputs: " << floatBytes
+                << " bytes per point, " << seedsReference << " seeds\n";
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << arg << std::endl;
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--geometry")
+      opt.geometries.push_back(next());
+    else if (arg == "--hits")
+      opt.hits = std::stod(next());
+    else if (arg == "--resolution") {
+      opt.resolutions.clear();
+      for (const auto& item : split(next()))
+        opt.resolutions.push_back(std::stof(item));
+    } else if (arg == "--weights") {
+      opt.weightFormats = split(next());
+      for (const auto& name : opt.weightFormats) {
+        clue::WeightFormat format = clue::WeightFormat::Float32;
+        if (!weightFormatFromName(name, format)) {
+          std::cerr << "Unknown weight format " << name << std::endl;
+          return 1;
+        }
+      }
+    } else if (arg == "--dc")
+      opt.dc = std::stof(next());
+    else if (arg == "--rhoc")
+      opt.rhoc = std::stof(next());
+    else if (arg == "--outlierDeltaFactor")
+      opt.outlierDeltaFactor = std::stof(next());
+    else if (arg == "--seed")
+      opt.seed = std::stoull(next());
+    else if (arg == "--csv")
+      opt.csv = true;
+    else {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (opt.geometries.empty())
+    clue::forEachCLUEAlgo([&](auto, const char* name) { opt.geometries.push_back(name); });
+
+  printHeader(opt.csv);
+  for (const auto& geometry : opt.geometries) {
+    bool found = clue::dispatchCLUEAlgo(geometry, [&](auto tag) { validate<typename decltype(tag)::type>(opt, geometry); });
+    if (!found)
+      std::cerr << "Unknown geometry " << geometry << std::endl;
+  }
+  return 0;
+}
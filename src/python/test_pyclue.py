@@ -0,0 +1,104 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Checks of the pyclue bindings: results, zero-copy inputs and views, input
+# checks and concurrent clustering from several Python threads
+#
+import gc
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+import pyclue
+
+
+def make_event(seed, n=20000, nLayers=80):
+    rng = np.random.default_rng(seed)
+    x = rng.uniform(-2000.0, 2000.0, n).astype(np.float32)
+    y = rng.uniform(-2000.0, 2000.0, n).astype(np.float32)
+    layer = rng.integers(0, nLayers, n, dtype=np.int32)
+    weight = rng.exponential(0.05, n).astype(np.float32)
+    return x, y, layer, weight
+
+
+def cluster(event):
+    algo = pyclue.CLICdetEndcapCLUEAlgo(15.0, 0.02, 3.0)
+    algo.setPoints(*event)
+    algo.makeClusters()
+    return algo.clusterIndex.copy(), algo.isSeed.copy()
+
+
+algo = pyclue.CLICdetEndcapCLUEAlgo(dc=15.0, rhoc=0.02, outlierDeltaFactor=3.0)
+assert algo.endcap
+event = make_event(1)
+algo.setPoints(*event)
+algo.makeClusters()
+
+n = len(event[0])
+for name in ("rho", "delta", "nearestHigher", "clusterIndex", "isSeed"):
+    assert getattr(algo, name).shape == (n,), name
+seeds = np.flatnonzero(algo.isSeed)
+assert len(seeds) > 0
+assert np.array_equal(np.sort(algo.clusterIndex[seeds]), np.arange(len(seeds)))
+assert np.all(algo.rho[seeds] >= algo.rhoc)
+
+# the results are views of the algo buffers
+rho = algo.rho
+assert not rho.flags.owndata
+assert rho.__array_interface__["data"][0] == algo.rho.__array_interface__["data"][0]
+
+# the inputs are read in place: the algo keeps them until its next setPoints,
+# also when the caller does not
+x = event[0].copy()
+refs = sys.getrefcount(x)
+algo.setPoints(x, *event[1:])
+assert sys.getrefcount(x) == refs + 1
+algo.setPoints(*event)
+assert sys.getrefcount(x) == refs
+algo.setPoints(*(a.copy() for a in event))
+gc.collect()
+algo.makeClusters()
+assert np.array_equal(algo.clusterIndex, cluster(event)[0])
+
+# the inputs are not converted
+for bad in (event[0].astype(np.float64), event[0][::2]):
+    try:
+        algo.setPoints(bad, *event[1:])
+    except TypeError:
+        pass
+    else:
+        raise AssertionError("converted input accepted")
+
+# the barrel geometries need r
+barrel = pyclue.CLICdetBarrelCLUEAlgo(15.0, 0.02, 3.0)
+try:
+    barrel.setPoints(*event)
+except ValueError:
+    pass
+else:
+    raise AssertionError("missing r accepted")
+
+# the GIL is released during the clustering: same results from several threads
+events = [make_event(seed) for seed in range(8)]
+serial = [cluster(e) for e in events]
+with ThreadPoolExecutor(4) as pool:
+    threaded = list(pool.map(cluster, events))
+for (ci, s), (cit, st) in zip(serial, threaded):
+    assert np.array_equal(ci, cit) and np.array_equal(s, st)
+
+print("pyclue OK")